@@ -1 +1,2 @@
 #include "src/PluginHost.cpp"
+#include "src/RealtimeSanitizer.cpp"
@@ -1,7 +1,26 @@
 #pragma once
 
+#include "src/BlockDeadlineMonitor.h"
+#include "src/GenericPluginEditor.h"
 #include "src/KnownPluginListScanner.h"
+#include "src/ListenerRegistry.h"
+#include "src/MidiEventArena.h"
+#include "src/PluginCatalog.h"
+#include "src/PluginDiscoveryService.h"
 #include "src/PluginHost.h"
+#include "src/PluginKeyTable.h"
+#include "src/PluginProcessingAdapter.h"
+#include "src/PluginProcessingState.h"
+#include "src/PluginProfiler.h"
 #include "src/PluginScan.h"
+#include "src/PluginScanFilter.h"
+#include "src/PluginScanScheduler.h"
 #include "src/PluginWindow.h"
 #include "src/PluginWindowLookAndFeel.h"
+#include "src/RealtimePluginGraph.h"
+#include "src/RealtimeSanitizer.h"
+#include "src/SandboxTransport.h"
+#include "src/SandboxedPluginInstance.h"
+#include "src/SharedPluginCatalog.h"
+#include "src/TelemetryPipeline.h"
+#include "src/TraceRecorder.h"
@@ -0,0 +1,121 @@
+#pragma once
+#include "PluginKeyTable.h"
+#include <imagiro_util/imagiro_util.h>
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <atomic>
+
+namespace timeoffaudio {
+    /*
+        Watches the time taken by each realtime block against the block duration given to prepare().
+
+        The realtime thread brackets each block with beginBlock()/endBlock(), and reports the time spent in each
+        plugin via pluginProcessed(). When a block takes longer than the configured fraction of its duration, the
+        most expensive plugin of that block is recorded into a lock-free ring, which the message thread drains
+        via popOverrun(). Plugins are recorded by their PluginKeyTable handle, as the instance may be gone (and its
+        address reused) by the time the message thread looks at the overrun. The instance pointer is only kept to
+        check that the handle's key still holds the same plugin, it must not be dereferenced.
+
+        Like PluginHost::withRealtimeAccess, this assumes a single realtime thread.
+    */
+    class BlockDeadlineMonitor {
+    public:
+        static constexpr int MAX_PENDING_OVERRUNS = 256;
+
+        struct Overrun {
+            PluginKeyTable::Handle worstHandle             = PluginKeyTable::invalidHandle;
+            const juce::AudioPluginInstance* worstInstance = nullptr;
+            double worstPluginMicros                       = 0.0;
+            double blockMicros                             = 0.0;
+            double deadlineMicros                          = 0.0;
+        };
+
+        BlockDeadlineMonitor() : microsPerTick (1.0e6 / (double) juce::Time::getHighResolutionTicksPerSecond()) {}
+
+        // context: message thread
+        void prepare (const double sampleRate, const int blockSize) {
+            blockDurationMicros.store (sampleRate > 0.0 ? 1.0e6 * (double) blockSize / sampleRate : 0.0);
+        }
+
+        // context: message thread
+        void setEnabled (bool shouldBeEnabled) noexcept { enabled.store (shouldBeEnabled, std::memory_order_relaxed); }
+        [[nodiscard]] bool isEnabled() const noexcept { return enabled.load (std::memory_order_relaxed); }
+
+        // The fraction of the block duration past which a block is considered to have overrun
+        // context: message thread
+        void setDeadlineFraction (double newFraction) noexcept {
+            jassert (newFraction > 0.0);
+            deadlineFraction.store (newFraction, std::memory_order_relaxed);
+        }
+        [[nodiscard]] double getDeadlineFraction() const noexcept {
+            return deadlineFraction.load (std::memory_order_relaxed);
+        }
+
+        // context: realtime
+        void beginBlock() noexcept {
+            isMonitoringBlock = isEnabled() && blockDurationMicros.load (std::memory_order_relaxed) > 0.0;
+            if (!isMonitoringBlock) return;
+
+            blockStartTicks  = juce::Time::getHighResolutionTicks();
+            worstHandle      = PluginKeyTable::invalidHandle;
+            worstInstance    = nullptr;
+            worstPluginTicks = 0;
+        }
+
+        // context: realtime
+        void pluginProcessed (const PluginKeyTable::Handle handle,
+            const juce::AudioPluginInstance* instance,
+            const juce::int64 elapsedTicks) noexcept {
+            if (!isMonitoringBlock || elapsedTicks <= worstPluginTicks) return;
+
+            worstHandle      = handle;
+            worstInstance    = instance;
+            worstPluginTicks = elapsedTicks;
+        }
+
+        // context: realtime
+        void endBlock() noexcept {
+            if (!isMonitoringBlock) return;
+            isMonitoringBlock = false;
+
+            const auto blockTicks     = juce::Time::getHighResolutionTicks() - blockStartTicks;
+            const auto blockMicros    = (double) blockTicks * microsPerTick;
+            const auto deadlineMicros = blockDurationMicros.load (std::memory_order_relaxed) * getDeadlineFraction();
+            if (blockMicros <= deadlineMicros) return;
+
+            if (!overruns.try_enqueue (
+                    { worstHandle,
+                        worstInstance,
+                        (double) worstPluginTicks * microsPerTick,
+                        blockMicros,
+                        deadlineMicros }))
+                numDroppedOverruns.fetch_add (1, std::memory_order_relaxed);
+        }
+
+        // context: message thread
+        bool popOverrun (Overrun& overrun) { return overruns.try_dequeue (overrun); }
+
+        // The number of overruns that could not be recorded because the ring was full
+        [[nodiscard]] int getNumDroppedOverruns() const noexcept {
+            return numDroppedOverruns.load (std::memory_order_relaxed);
+        }
+
+    private:
+        const double microsPerTick;
+        std::atomic<bool> enabled { true };
+        std::atomic<double> deadlineFraction { 0.9 };
+        std::atomic<double> blockDurationMicros { 0.0 };
+        std::atomic<int> numDroppedOverruns { 0 };
+
+        moodycamel::ReaderWriterQueue<Overrun> overruns { MAX_PENDING_OVERRUNS };
+
+        // Only ever touched by the realtime thread
+        bool isMonitoringBlock                         = false;
+        juce::int64 blockStartTicks                    = 0;
+        juce::int64 worstPluginTicks                   = 0;
+        PluginKeyTable::Handle worstHandle             = PluginKeyTable::invalidHandle;
+        const juce::AudioPluginInstance* worstInstance = nullptr;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BlockDeadlineMonitor)
+    };
+}
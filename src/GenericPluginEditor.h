@@ -0,0 +1,196 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <juce_gui_basics/juce_gui_basics.h>
+
+#include <atomic>
+#include <memory>
+
+namespace timeoffaudio {
+    /*
+        The editor shown for plugins that don't have one (or are sandboxed), in place of
+        juce::GenericAudioProcessorEditor, which builds components for every parameter up front and so takes seconds
+        to open for plugins with thousands of them.
+
+        Parameters are listed in a ListBox, which only creates rows for the ones in view and reuses them while
+        scrolling. Rather than a listener per parameter, the editor listens to the processor once: changes only mark
+        their parameter as dirty, and the visible rows are refreshed from those marks on a timer.
+    */
+    class GenericPluginEditor final : public juce::AudioProcessorEditor,
+                                      private juce::ListBoxModel,
+                                      private juce::AudioProcessorListener,
+                                      private juce::Timer {
+    public:
+        static constexpr int ROW_HEIGHT      = 28;
+        static constexpr int REFRESH_RATE_HZ = 30;
+
+        // The parameters worth showing to users, i.e. without MIDI CC, bypass and other housekeeping parameters
+        static juce::Array<juce::AudioProcessorParameter*> getUserFacingParameters (juce::AudioProcessor& processor) {
+            auto parameters = processor.getParameters();
+
+            parameters.removeIf ([] (const juce::AudioProcessorParameter* param) {
+                for (const auto prefix : { "midi cc", "internal", "bypass", "reserved", "in", "out", "-" })
+                    if (param->getName (1024).toLowerCase().startsWith (prefix)) return true;
+
+                return false;
+            });
+
+            return parameters;
+        }
+
+        explicit GenericPluginEditor (juce::AudioProcessor& processor)
+            : AudioProcessorEditor (processor),
+              parameters (getUserFacingParameters (processor)),
+              numProcessorParameters (processor.getParameters().size()),
+              dirtyParameters (std::make_unique<std::atomic<bool>[]> ((size_t) numProcessorParameters)) {
+            list.setModel (this);
+            list.setRowHeight (ROW_HEIGHT);
+            list.setColour (juce::ListBox::backgroundColourId, juce::Colours::transparentBlack);
+            addAndMakeVisible (list);
+
+            processor.addListener (this);
+            startTimerHz (REFRESH_RATE_HZ);
+
+            setResizable (true, false);
+            setSize (400, juce::jlimit (ROW_HEIGHT, 600, parameters.size() * ROW_HEIGHT));
+        }
+
+        ~GenericPluginEditor() override {
+            processor.removeListener (this);
+            list.setModel (nullptr);
+        }
+
+        void paint (juce::Graphics& g) override {
+            g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
+        }
+
+        void resized() override { list.setBounds (getLocalBounds()); }
+
+    private:
+        class ParameterRow final : public juce::Component {
+        public:
+            ParameterRow() {
+                name.setMinimumHorizontalScale (1.f);
+                name.setInterceptsMouseClicks (false, false);
+                addAndMakeVisible (name);
+
+                slider.setSliderStyle (juce::Slider::LinearHorizontal);
+                slider.setTextBoxStyle (juce::Slider::TextBoxRight, false, 100, ROW_HEIGHT - 6);
+                slider.setRange (0.0, 1.0);
+                slider.onDragStart   = [this] { if (parameter) parameter->beginChangeGesture(); };
+                slider.onDragEnd     = [this] { if (parameter) parameter->endChangeGesture(); };
+                slider.onValueChange = [this] {
+                    if (parameter) parameter->setValueNotifyingHost ((float) slider.getValue());
+                };
+                slider.textFromValueFunction = [this] (double value) {
+                    return parameter ? (parameter->getText ((float) value, 1024) + " " + parameter->getLabel()).trim()
+                                     : juce::String();
+                };
+                slider.valueFromTextFunction = [this] (const juce::String& text) {
+                    return parameter ? (double) parameter->getValueForText (text) : 0.0;
+                };
+                addAndMakeVisible (slider);
+            }
+
+            // Rows are reused for other parameters while scrolling
+            void setParameter (juce::AudioProcessorParameter* newParameter) {
+                if (parameter == newParameter) return;
+
+                parameter = newParameter;
+                name.setText (parameter ? parameter->getName (128) : juce::String(), juce::dontSendNotification);
+
+                const auto numSteps  = parameter ? parameter->getNumSteps() : 0;
+                const auto isStepped = parameter && parameter->isDiscrete() && numSteps > 1
+                                       && numSteps < juce::AudioProcessor::getDefaultNumParameterSteps();
+                slider.setRange (0.0, 1.0, isStepped ? 1.0 / (numSteps - 1) : 0.0);
+            }
+
+            void refresh() {
+                // Don't fight the user over the value being dragged
+                if (!parameter || slider.isMouseButtonDown()) return;
+
+                slider.setValue (parameter->getValue(), juce::dontSendNotification);
+                slider.updateText();
+            }
+
+            juce::AudioProcessorParameter* getParameter() const { return parameter; }
+
+            void resized() override {
+                auto bounds = getLocalBounds().reduced (4, 2);
+                name.setBounds (bounds.removeFromLeft (juce::jmin (160, bounds.getWidth() / 3)));
+                slider.setBounds (bounds);
+            }
+
+        private:
+            juce::AudioProcessorParameter* parameter = nullptr;
+            juce::Label name;
+            juce::Slider slider;
+
+            JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ParameterRow)
+        };
+
+        const juce::Array<juce::AudioProcessorParameter*> parameters;
+        const int numProcessorParameters;
+        juce::ListBox list;
+
+        // Indexed by the processor's parameter index, set from any thread and cleared by the timer. Marks of rows out
+        // of view are left alone, as rows are refreshed anyway when they come into view.
+        std::unique_ptr<std::atomic<bool>[]> dirtyParameters;
+        std::atomic<bool> anyParameterDirty { false }, allParametersDirty { false };
+
+        int getNumRows() override { return parameters.size(); }
+
+        void paintListBoxItem (int, juce::Graphics&, int, int, bool) override {}
+
+        juce::Component* refreshComponentForRow (int row, bool, juce::Component* existingComponentToUpdate) override {
+            auto* rowComponent = dynamic_cast<ParameterRow*> (existingComponentToUpdate);
+            if (!juce::isPositiveAndBelow (row, parameters.size())) {
+                delete existingComponentToUpdate;
+                return nullptr;
+            }
+
+            if (rowComponent == nullptr) {
+                delete existingComponentToUpdate;
+                rowComponent = new ParameterRow();
+            }
+
+            rowComponent->setParameter (parameters[row]);
+            rowComponent->refresh();
+            return rowComponent;
+        }
+
+        void audioProcessorParameterChanged (juce::AudioProcessor*, int parameterIndex, float) override {
+            if (!juce::isPositiveAndBelow (parameterIndex, numProcessorParameters)) return;
+
+            dirtyParameters[(size_t) parameterIndex].store (true, std::memory_order_relaxed);
+            anyParameterDirty.store (true, std::memory_order_release);
+        }
+
+        void audioProcessorChanged (juce::AudioProcessor*,
+            const juce::AudioProcessor::ChangeDetails& details) override {
+            // Presets and such don't necessarily report every parameter they change
+            if (!details.parameterInfoChanged && !details.programChanged) return;
+
+            allParametersDirty.store (true, std::memory_order_relaxed);
+            anyParameterDirty.store (true, std::memory_order_release);
+        }
+
+        // Only the rows in view are refreshed, the others pick up their value when scrolled to
+        void timerCallback() override {
+            if (!anyParameterDirty.exchange (false, std::memory_order_acquire)) return;
+            const auto refreshAll = allParametersDirty.exchange (false, std::memory_order_relaxed);
+
+            for (auto row = juce::jmax (0, list.getRowContainingPosition (0, 0)); row < parameters.size(); ++row) {
+                auto* rowComponent = dynamic_cast<ParameterRow*> (list.getComponentForRowNumber (row));
+                if (rowComponent == nullptr) break;
+
+                const auto index = rowComponent->getParameter()->getParameterIndex();
+                const auto isDirty =
+                    juce::isPositiveAndBelow (index, numProcessorParameters)
+                    && dirtyParameters[(size_t) index].exchange (false, std::memory_order_relaxed);
+                if (isDirty || refreshAll) rowComponent->refresh();
+            }
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GenericPluginEditor)
+    };
+}
@@ -1,36 +1,47 @@
 #pragma once
+#include "PluginScanFilter.h"
+#include "TraceRecorder.h"
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <juce_events/juce_events.h>
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace timeoffaudio {
 
     constexpr const char* PROCESS_UID = "pluginScanner";
     constexpr const char* PROCESS_NAME = "time off audio plugin scanner";
 
-    class CustomPluginScanner final : public juce::KnownPluginList::CustomScanner {
-    public:
-        class SubprocessCoordinator final : private juce::ChildProcessCoordinator {
-        public:
-            SubprocessCoordinator() {
-                // Firstly, look for the plugin scanner in the common application data directory
-                auto pluginScannerLocation = juce::File::getSpecialLocation (juce::File::commonApplicationDataDirectory)
+    // The scanner executable, which also hosts sandboxed plugins (see SandboxedPluginInstance)
+    inline juce::File getPluginScannerExecutable() {
+        // Firstly, look for the plugin scanner in the common application data directory
+        auto pluginScannerLocation = juce::File::getSpecialLocation (juce::File::commonApplicationDataDirectory)
 #if JUCE_MAC
-                                                 .getChildFile ("Application Support")
+                                         .getChildFile ("Application Support")
 #endif
-                                                 .getChildFile (JucePlugin_Manufacturer)
-                                                 .getChildFile (PROCESS_NAME);
+                                         .getChildFile (JucePlugin_Manufacturer)
+                                         .getChildFile (PROCESS_NAME);
 
-                // If it doesn't exist, look in the user application data directory
-                if (!pluginScannerLocation.existsAsFile()) {
-                    pluginScannerLocation = juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+        // If it doesn't exist, look in the user application data directory
+        if (!pluginScannerLocation.existsAsFile()) {
+            pluginScannerLocation = juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
 #if JUCE_MAC
-                                                .getChildFile ("Application Support")
+                                        .getChildFile ("Application Support")
 #endif
-                                                .getChildFile (JucePlugin_Manufacturer)
-                                                .getChildFile (PROCESS_NAME);
-                }
+                                        .getChildFile (JucePlugin_Manufacturer)
+                                        .getChildFile (PROCESS_NAME);
+        }
+
+        return pluginScannerLocation;
+    }
 
-                if (!launchWorkerProcess (pluginScannerLocation.getFullPathName(), PROCESS_UID, 0, 0)) {
+    class CustomPluginScanner final : public juce::KnownPluginList::CustomScanner {
+    public:
+        class SubprocessCoordinator final : private juce::ChildProcessCoordinator {
+        public:
+            SubprocessCoordinator() {
+                if (!launchWorkerProcess (getPluginScannerExecutable().getFullPathName(), PROCESS_UID, 0, 0)) {
                     // TODO: what should I do here if this ever happens? Ideally fallback to in-process scanning.
                 }
             }
@@ -87,18 +98,46 @@ namespace timeoffaudio {
         CustomPluginScanner(ScanFilter filter) : filter(filter) {}
         ~CustomPluginScanner() override {}
 
+        /*
+            Can be called from several scan threads at once (i.e. when scanning several formats concurrently). Each
+            call borrows a worker process from a pool shared by all scans, launching a new one if they are all busy,
+            so there are never more worker processes than scan threads.
+        */
         bool findPluginTypesFor (juce::AudioPluginFormat& format,
             juce::OwnedArray<juce::PluginDescription>& result,
             const juce::String& fileOrIdentifier) override {
-            if (addPluginDescriptions (format.getName(), fileOrIdentifier, result)) return true;
+            auto coordinator = acquireCoordinator();
+            if (!addPluginDescriptions (*coordinator, format.getName(), fileOrIdentifier, result)) return false;
 
-            scanCoordinator = nullptr;
-            return false;
+            // An interrupted worker might still send the result for this file, so it can't be reused
+            if (shouldExit()) return true;
+
+            const std::lock_guard lock (coordinatorsMutex);
+            idleCoordinators.push_back (std::move (coordinator));
+            return true;
         }
 
-        void scanFinished() override { scanCoordinator = nullptr; }
+        // Shuts the idle worker processes down, the ones still scanning for another scan are kept until it finishes
+        void scanFinished() override {
+            const std::lock_guard lock (coordinatorsMutex);
+            idleCoordinators.clear();
+        }
 
     private:
+        std::unique_ptr<SubprocessCoordinator> acquireCoordinator() {
+            {
+                const std::lock_guard lock (coordinatorsMutex);
+                if (!idleCoordinators.empty()) {
+                    auto coordinator = std::move (idleCoordinators.back());
+                    idleCoordinators.pop_back();
+                    return coordinator;
+                }
+            }
+
+            // Launching a worker process takes a while, don't hold up the other scan threads meanwhile
+            return std::make_unique<SubprocessCoordinator>();
+        }
+
         /*  Scans for a plugin with format 'formatName' and ID 'fileOrIdentifier' using a subprocess,
         and adds discovered plugin descriptions to 'result'.
 
@@ -106,22 +145,23 @@ namespace timeoffaudio {
 
         Failure indicates that the subprocess is unrecoverable and should be terminated.
     */
-        bool addPluginDescriptions (const juce::String& formatName,
+        bool addPluginDescriptions (SubprocessCoordinator& scanCoordinator,
+            const juce::String& formatName,
             const juce::String& fileOrIdentifier,
             juce::OwnedArray<juce::PluginDescription>& result) {
-            if (scanCoordinator == nullptr) scanCoordinator = std::make_unique<SubprocessCoordinator>();
+            TIMEOFFAUDIO_TRACE_SCOPE_WITH_DETAIL ("scan", "scannerRoundTrip", fileOrIdentifier);
 
             juce::MemoryBlock block;
             juce::MemoryOutputStream stream { block, true };
             stream.writeString (formatName);
             stream.writeString (fileOrIdentifier);
 
-            if (!scanCoordinator->sendMessageToWorker (block)) return false;
+            if (!scanCoordinator.sendMessageToWorker (block)) return false;
 
             for (;;) {
                 if (shouldExit()) return true;
 
-                const auto response = scanCoordinator->getResponse();
+                const auto response = scanCoordinator.getResponse();
 
                 if (response.state == SubprocessCoordinator::State::timeout) continue;
 
@@ -141,7 +181,8 @@ namespace timeoffaudio {
             }
         }
 
-        std::unique_ptr<SubprocessCoordinator> scanCoordinator;
+        std::mutex coordinatorsMutex;
+        std::vector<std::unique_ptr<SubprocessCoordinator>> idleCoordinators;
         ScanFilter filter;
 
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CustomPluginScanner)
@@ -0,0 +1,194 @@
+#pragma once
+#include <juce_core/juce_core.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <vector>
+
+namespace timeoffaudio {
+    /*
+        A copy-on-write listener list, so that notifying listeners from any thread takes no lock.
+
+        Adding or removing a listener copies the list and publishes the copy atomically, notifications iterate
+        whichever list was current when they started. Replaced lists are freed by the next add or remove that finds
+        no notification in progress.
+
+        Removing a listener waits for notifications of that listener in progress on other threads, so it is safe to
+        delete a listener after removing it. Dispatches to that same listener further up the calling thread's stack
+        (i.e. a listener removing itself from within its own callback) aren't waited for, as they can't finish first.
+        Removing it from within another listener's callback still waits for it.
+
+        Every dispatch to a listener is timed, see getDispatchStats(), to find listeners that hold up notifications.
+    */
+    template <typename ListenerType>
+    class ListenerRegistry {
+    public:
+        struct DispatchStats {
+            const ListenerType* listener = nullptr;
+            std::string typeName;
+            uint64_t numDispatches = 0;
+            double totalMicros     = 0.0;
+            double maxMicros       = 0.0;
+        };
+
+        ListenerRegistry() { publish (std::make_unique<Snapshot>()); }
+        ~ListenerRegistry() { jassert (readers.load() == 0); }
+
+        void add (ListenerType* listener) {
+            jassert (listener);
+            const std::lock_guard lock (writerMutex);
+
+            const auto& entries = *current.load();
+            for (const auto& entry : entries)
+                if (entry.listener == listener) return;
+
+            auto newEntries = std::make_unique<Snapshot> (entries);
+            newEntries->push_back ({ listener, std::make_shared<EntryState> (typeid (*listener).name()) });
+            publish (std::move (newEntries));
+        }
+
+        void remove (ListenerType* listener) {
+            std::shared_ptr<EntryState> removedState;
+
+            {
+                const std::lock_guard lock (writerMutex);
+
+                auto newEntries = std::make_unique<Snapshot>();
+                for (const auto& entry : *current.load()) {
+                    if (entry.listener == listener)
+                        removedState = entry.state;
+                    else
+                        newEntries->push_back (entry);
+                }
+
+                if (!removedState) return;
+                removedState->isRemoved.store (true);
+                publish (std::move (newEntries));
+            }
+
+            // Notifications that already picked up the listener finish before it can be deleted, except for the
+            // ones this thread is in the middle of
+            const auto numOwnDispatches = countActiveDispatchesOf (removedState.get());
+            while (removedState->numDispatchesInFlight.load() > numOwnDispatches) std::this_thread::yield();
+        }
+
+        bool isEmpty() const {
+            const ScopedReader reader (*this);
+            return current.load()->empty();
+        }
+
+        // Calls the given callback on every listener, from any thread, without locking
+        template <typename... CallbackArgs, typename... Args>
+        void call (void (ListenerType::*callback) (CallbackArgs...), Args&&... args) const {
+            const ScopedReader reader (*this);
+            const auto& entries = *current.load();
+
+            for (const auto& entry : entries) {
+                auto& state = *entry.state;
+                state.numDispatchesInFlight.fetch_add (1);
+
+                if (!state.isRemoved.load()) {
+                    const ScopedActiveDispatch activeDispatch (state);
+                    const auto startTicks = juce::Time::getHighResolutionTicks();
+                    (entry.listener->*callback) (args...);
+                    state.recordDispatch (juce::Time::getHighResolutionTicks() - startTicks);
+                }
+
+                state.numDispatchesInFlight.fetch_sub (1);
+            }
+        }
+
+        std::vector<DispatchStats> getDispatchStats() const {
+            const ScopedReader reader (*this);
+
+            std::vector<DispatchStats> stats;
+            for (const auto& entry : *current.load()) {
+                const auto& state = *entry.state;
+                stats.push_back ({ entry.listener,
+                    state.typeName,
+                    state.numDispatches.load (std::memory_order_relaxed),
+                    ticksToMicros (state.totalTicks.load (std::memory_order_relaxed)),
+                    ticksToMicros (state.maxTicks.load (std::memory_order_relaxed)) });
+            }
+            return stats;
+        }
+
+    private:
+        struct EntryState {
+            explicit EntryState (std::string name) : typeName (std::move (name)) {}
+
+            const std::string typeName;
+            std::atomic<bool> isRemoved { false };
+            std::atomic<int> numDispatchesInFlight { 0 };
+            std::atomic<uint64_t> numDispatches { 0 };
+            std::atomic<int64_t> totalTicks { 0 }, maxTicks { 0 };
+
+            void recordDispatch (const int64_t ticks) {
+                numDispatches.fetch_add (1, std::memory_order_relaxed);
+                totalTicks.fetch_add (ticks, std::memory_order_relaxed);
+
+                auto previousMax = maxTicks.load (std::memory_order_relaxed);
+                while (ticks > previousMax
+                       && !maxTicks.compare_exchange_weak (previousMax, ticks, std::memory_order_relaxed)) {}
+            }
+        };
+
+        struct Entry {
+            ListenerType* listener;
+            std::shared_ptr<EntryState> state;
+        };
+        using Snapshot = std::vector<Entry>;
+
+        // Counts the threads iterating a snapshot, replaced snapshots are only freed while there are none
+        struct ScopedReader {
+            explicit ScopedReader (const ListenerRegistry& r) : registry (r) { registry.readers.fetch_add (1); }
+            ~ScopedReader() { registry.readers.fetch_sub (1); }
+            const ListenerRegistry& registry;
+        };
+
+        std::mutex writerMutex;
+        std::vector<std::unique_ptr<Snapshot>> snapshots; // Guarded by writerMutex, the last one is current
+        std::atomic<Snapshot*> current { nullptr };
+        mutable std::atomic<int> readers { 0 };
+
+        // The entries this thread is dispatching to, innermost first, as a list of stack frames so that
+        // dispatching doesn't allocate. Entry states are unique to their registry, so sharing the list between the
+        // registries of the same ListenerType is fine.
+        struct ScopedActiveDispatch {
+            explicit ScopedActiveDispatch (const EntryState& s) : state (&s), outer (activeDispatches) {
+                activeDispatches = this;
+            }
+            ~ScopedActiveDispatch() { activeDispatches = outer; }
+
+            const EntryState* const state;
+            ScopedActiveDispatch* const outer;
+        };
+        inline static thread_local ScopedActiveDispatch* activeDispatches = nullptr;
+
+        static int countActiveDispatchesOf (const EntryState* state) {
+            int count = 0;
+            for (auto* dispatch = activeDispatches; dispatch != nullptr; dispatch = dispatch->outer)
+                if (dispatch->state == state) ++count;
+            return count;
+        }
+
+        void publish (std::unique_ptr<Snapshot> snapshot) {
+            current.store (snapshot.get());
+            snapshots.push_back (std::move (snapshot));
+
+            // Readers load the current snapshot after registering, so with none registered now, none can be
+            // holding on to a replaced one
+            if (readers.load() == 0) snapshots.erase (snapshots.begin(), snapshots.end() - 1);
+        }
+
+        static double ticksToMicros (const int64_t ticks) {
+            return juce::Time::highResolutionTicksToSeconds (ticks) * 1.0e6;
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ListenerRegistry)
+    };
+}
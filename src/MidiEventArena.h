@@ -0,0 +1,90 @@
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+
+#include <atomic>
+
+namespace timeoffaudio {
+    /*
+        A MidiBuffer with storage preallocated at prepare time, so that routing MIDI between plugins doesn't
+        allocate on the realtime thread.
+
+        MidiBuffer grows on demand, so events the host adds are checked against the preallocated capacity first, and
+        events that don't fit get dropped and counted instead. Events a plugin adds itself during processBlock can't
+        be stopped from growing the storage, but growing past the capacity is detected and counted as an overflow.
+        The grown storage is kept, so it only allocates once.
+    */
+    class MidiEventArena {
+    public:
+        struct Limits {
+            int maxEventsPerBlock = 2048;
+            int maxBytesPerEvent  = 3; // Larger events (i.e. SysEx) take up the space of several events
+        };
+
+        MidiEventArena() = default;
+
+        // Only call this while the arena is not being used by the realtime thread
+        void prepare (const Limits& limits) {
+            capacityBytes = (int) juce::jmax (0, limits.maxEventsPerBlock) * getEventSize (limits.maxBytesPerEvent);
+            buffer.clear();
+            buffer.ensureSize ((size_t) capacityBytes);
+        }
+
+        juce::MidiBuffer& getBuffer() /* context: realtime */ { return buffer; }
+        const juce::MidiBuffer& getBuffer() const /* context: realtime */ { return buffer; }
+
+        // Keeps the storage around
+        void clear() /* context: realtime */ { buffer.clear(); }
+
+        // Appends the events that fit the remaining capacity, and drops the rest
+        void addEvents (const juce::MidiBuffer& source) /* context: realtime */ {
+            if (const auto numDropped = addEventsWithinCapacity (buffer, source, capacityBytes); numDropped > 0)
+                numDroppedEvents.fetch_add ((uint64_t) numDropped, std::memory_order_relaxed);
+        }
+
+        // Appends the events of source that fit destination without growing it past capacityBytes, and returns the
+        // number of events that were dropped
+        static int addEventsWithinCapacity (juce::MidiBuffer& destination,
+            const juce::MidiBuffer& source,
+            const int capacityBytes) /* context: realtime */ {
+            int numDropped = 0;
+            for (const auto metadata : source) {
+                if (!hasRoomFor (destination, metadata.numBytes, capacityBytes)) {
+                    ++numDropped;
+                    continue;
+                }
+
+                destination.addEvent (metadata.data, metadata.numBytes, metadata.samplePosition);
+            }
+
+            return numDropped;
+        }
+
+        // Whether an event of numBytes can be added to buffer without growing it past capacityBytes
+        static bool hasRoomFor (const juce::MidiBuffer& buffer, const int numBytes, const int capacityBytes) {
+            return buffer.data.size() + getEventSize (numBytes) <= capacityBytes;
+        }
+
+        // Call after the plugin processed the buffer, to account for any events it added past the capacity
+        void pluginProcessed() /* context: realtime */ {
+            if (buffer.data.size() <= capacityBytes) return;
+
+            numPluginOverflows.fetch_add (1, std::memory_order_relaxed);
+            capacityBytes = buffer.data.size();
+        }
+
+        uint64_t getNumDroppedEvents() const { return numDroppedEvents.load (std::memory_order_relaxed); }
+        uint64_t getNumPluginOverflows() const { return numPluginOverflows.load (std::memory_order_relaxed); }
+
+    private:
+        juce::MidiBuffer buffer;
+        int capacityBytes = 0;
+        std::atomic<uint64_t> numDroppedEvents { 0 }, numPluginOverflows { 0 };
+
+        // MidiBuffer stores each event as a 32-bit sample position and 16-bit size, followed by the data
+        static int getEventSize (const int numBytes) {
+            return (int) (sizeof (int32_t) + sizeof (uint16_t)) + juce::jmax (0, numBytes);
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiEventArena)
+    };
+}
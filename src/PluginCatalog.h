@@ -0,0 +1,310 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace timeoffaudio {
+    /*
+        A searchable index over the known plugins, so that plugin browsers can filter thousands of plugins on every
+        keystroke without copying and scanning the whole list.
+
+        Names, manufacturers and categories are split into lowercase tokens, and every token maps to the plugins it
+        appears in. A query matches plugins containing every one of its tokens, either exactly, as a prefix, or (for
+        tokens of 4 characters or more) within a small edit distance, to forgive typos. Results are ranked by how
+        well, and in which field, each token matched, and come back a page at a time along with facet counts
+        (manufacturers, categories and formats) over all matches.
+
+        update() diffs the plugins it is given against the indexed ones, and only (re)indexes the ones that were
+        added, removed or changed, returning them as a Delta.
+
+        Not thread-safe, PluginHost only uses it from the message thread.
+    */
+    class PluginCatalog {
+    public:
+        struct Delta {
+            juce::Array<juce::PluginDescription> added, removed, changed;
+
+            bool isEmpty() const { return added.isEmpty() && removed.isEmpty() && changed.isEmpty(); }
+        };
+
+        struct Query {
+            juce::String text;                  // Empty to match every plugin
+            juce::String manufacturer;          // Facet filters, empty to not filter
+            juce::String category;              // Matches "Delay" in "Fx|Delay" as well
+            juce::String format;
+            std::optional<bool> isInstrument;
+            int offset = 0, limit = 50;
+        };
+
+        struct Results {
+            std::vector<juce::PluginDescription> plugins; // The requested page, best matches first
+            int numMatches = 0;                           // Across all pages
+            std::map<juce::String, int> manufacturers, categories, formats;
+        };
+
+        PluginCatalog() = default;
+
+        Delta update (const juce::Array<juce::PluginDescription>& types) {
+            Delta delta;
+
+            std::unordered_map<std::string, const juce::PluginDescription*> current;
+            current.reserve ((size_t) types.size());
+            for (const auto& type : types) current.emplace (type.createIdentifierString().toStdString(), &type);
+
+            for (auto it = idsByIdentifier.begin(); it != idsByIdentifier.end();) {
+                if (current.contains (it->first)) {
+                    ++it;
+                    continue;
+                }
+
+                delta.removed.add (entries[it->second]->description);
+                removeEntry (it->second);
+                it = idsByIdentifier.erase (it);
+            }
+
+            for (const auto& [identifier, type] : current) {
+                if (const auto existing = idsByIdentifier.find (identifier); existing != idsByIdentifier.end()) {
+                    if (isSameListing (entries[existing->second]->description, *type)) continue;
+
+                    delta.changed.add (*type);
+                    removeEntry (existing->second);
+                    existing->second = addEntry (*type);
+                    continue;
+                }
+
+                delta.added.add (*type);
+                idsByIdentifier.emplace (identifier, addEntry (*type));
+            }
+
+            return delta;
+        }
+
+        int size() const { return (int) idsByIdentifier.size(); }
+
+        Results search (const Query& query) const {
+            std::vector<std::pair<int, EntryId>> matches; // Score and entry
+            for (const auto& [id, score] : scoreMatches (tokenise (query.text)))
+                if (passesFilters (*entries[id], query)) matches.emplace_back (score, id);
+
+            std::sort (matches.begin(), matches.end(), [this] (const auto& a, const auto& b) {
+                if (a.first != b.first) return a.first > b.first;
+                return entries[a.second]->sortName < entries[b.second]->sortName;
+            });
+
+            Results results;
+            results.numMatches = (int) matches.size();
+
+            for (const auto& [_, id] : matches) {
+                const auto& description = entries[id]->description;
+                ++results.manufacturers[description.manufacturerName];
+                ++results.categories[description.category];
+                ++results.formats[description.pluginFormatName];
+            }
+
+            const auto first = (size_t) juce::jlimit (0, (int) matches.size(), query.offset);
+            const auto last  = (size_t) juce::jlimit ((int) first, (int) matches.size(), (int) first + query.limit);
+            for (auto index = first; index < last; ++index)
+                results.plugins.push_back (entries[matches[index].second]->description);
+
+            return results;
+        }
+
+    private:
+        using EntryId = uint32_t;
+
+        enum Field : uint8_t { nameField = 1, manufacturerField = 2, categoryField = 4 };
+        enum class MatchKind { fuzzy, prefix, exact };
+
+        struct Entry {
+            juce::PluginDescription description;
+            juce::String sortName;
+            std::vector<std::string> tokens;
+        };
+
+        std::vector<std::optional<Entry>> entries; // By EntryId, removed entries leave a hole for reuse
+        std::vector<EntryId> freeIds;
+        std::unordered_map<std::string, EntryId> idsByIdentifier;
+
+        // Token -> entries containing it, and the fields it appears in. Sorted, for prefix lookups.
+        std::map<std::string, std::unordered_map<EntryId, uint8_t>> postings;
+
+        EntryId addEntry (const juce::PluginDescription& description) {
+            EntryId id;
+            if (!freeIds.empty()) {
+                id = freeIds.back();
+                freeIds.pop_back();
+            } else {
+                id = (EntryId) entries.size();
+                entries.emplace_back();
+            }
+
+            auto& entry = entries[id].emplace();
+            entry.description = description;
+            entry.sortName    = description.name.toLowerCase();
+
+            const auto index = [&] (const juce::String& text, const Field field) {
+                for (const auto& token : tokenise (text)) {
+                    auto& fields = postings[token][id];
+                    if (fields == 0) entry.tokens.push_back (token);
+                    fields |= field;
+                }
+            };
+            index (description.name, Field::nameField);
+            index (description.manufacturerName, Field::manufacturerField);
+            index (description.category, Field::categoryField);
+
+            return id;
+        }
+
+        void removeEntry (const EntryId id) {
+            for (const auto& token : entries[id]->tokens) {
+                const auto posting = postings.find (token);
+                posting->second.erase (id);
+                if (posting->second.empty()) postings.erase (posting);
+            }
+
+            entries[id].reset();
+            freeIds.push_back (id);
+        }
+
+        // Whether the list has anything new to say about a plugin with the same identifier
+        static bool isSameListing (const juce::PluginDescription& a, const juce::PluginDescription& b) {
+            return a.name == b.name && a.manufacturerName == b.manufacturerName && a.category == b.category
+                   && a.version == b.version && a.isInstrument == b.isInstrument
+                   && a.lastFileModTime == b.lastFileModTime && a.numInputChannels == b.numInputChannels
+                   && a.numOutputChannels == b.numOutputChannels;
+        }
+
+        // Every query token has to match, an entry's score adds up the best match of each of them
+        std::unordered_map<EntryId, int> scoreMatches (const std::vector<std::string>& queryTokens) const {
+            std::unordered_map<EntryId, int> scores;
+            if (queryTokens.empty()) {
+                for (EntryId id = 0; id < entries.size(); ++id)
+                    if (entries[id]) scores.emplace (id, 0);
+                return scores;
+            }
+
+            for (size_t tokenIndex = 0; tokenIndex < queryTokens.size(); ++tokenIndex) {
+                std::unordered_map<EntryId, int> tokenScores;
+                forEachMatchingToken (queryTokens[tokenIndex], [&] (const auto& posting, const MatchKind kind) {
+                    for (const auto& [id, fields] : posting) {
+                        auto& score = tokenScores[id];
+                        score       = std::max (score, getScore (kind, fields));
+                    }
+                });
+
+                if (tokenIndex == 0) {
+                    scores = std::move (tokenScores);
+                    continue;
+                }
+
+                for (auto it = scores.begin(); it != scores.end();) {
+                    const auto tokenScore = tokenScores.find (it->first);
+                    if (tokenScore == tokenScores.end()) {
+                        it = scores.erase (it);
+                        continue;
+                    }
+
+                    it->second += tokenScore->second;
+                    ++it;
+                }
+            }
+
+            return scores;
+        }
+
+        template <typename Callback>
+        void forEachMatchingToken (const std::string& queryToken, Callback&& callback) const {
+            // Exact and prefix matches are a range of the sorted postings
+            for (auto it = postings.lower_bound (queryToken);
+                 it != postings.end() && it->first.compare (0, queryToken.size(), queryToken) == 0;
+                 ++it)
+                callback (it->second, it->first.size() == queryToken.size() ? MatchKind::exact : MatchKind::prefix);
+
+            const auto maxDistance = getMaxEditDistance (queryToken);
+            if (maxDistance == 0) return;
+
+            for (const auto& [token, posting] : postings) {
+                if (token.compare (0, queryToken.size(), queryToken) == 0) continue; // Already matched
+                if (isWithinEditDistance (queryToken, token, maxDistance)) callback (posting, MatchKind::fuzzy);
+            }
+        }
+
+        static int getScore (const MatchKind kind, const uint8_t fields) {
+            const auto kindScore  = kind == MatchKind::exact ? 3 : kind == MatchKind::prefix ? 2 : 1;
+            const auto fieldScore = (fields & Field::nameField) ? 4 : (fields & Field::manufacturerField) ? 2 : 1;
+            return kindScore * fieldScore;
+        }
+
+        static int getMaxEditDistance (const std::string& token) {
+            return token.size() >= 8 ? 2 : token.size() >= 4 ? 1 : 0;
+        }
+
+        // Levenshtein distance, giving up as soon as it can't be within maxDistance
+        static bool isWithinEditDistance (const std::string& a, const std::string& b, const int maxDistance) {
+            const auto lengthDifference = (int) a.size() - (int) b.size();
+            if (std::abs (lengthDifference) > maxDistance) return false;
+
+            std::vector<int> previous (b.size() + 1), row (b.size() + 1);
+            for (size_t j = 0; j <= b.size(); ++j) previous[j] = (int) j;
+
+            for (size_t i = 1; i <= a.size(); ++i) {
+                row[0]          = (int) i;
+                auto rowMinimum = row[0];
+                for (size_t j = 1; j <= b.size(); ++j) {
+                    const auto substitution = previous[j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1);
+                    row[j]                  = std::min ({ previous[j] + 1, row[j - 1] + 1, substitution });
+                    rowMinimum              = std::min (rowMinimum, row[j]);
+                }
+
+                if (rowMinimum > maxDistance) return false;
+                std::swap (previous, row);
+            }
+
+            return previous[b.size()] <= maxDistance;
+        }
+
+        static std::vector<std::string> tokenise (const juce::String& text) {
+            std::vector<std::string> tokens;
+            juce::String token;
+
+            const auto flush = [&] {
+                if (token.isNotEmpty()) tokens.push_back (token.toStdString());
+                token.clear();
+            };
+
+            for (auto character = text.toLowerCase().getCharPointer(); !character.isEmpty();) {
+                const auto c = character.getAndAdvance();
+                if (juce::CharacterFunctions::isLetterOrDigit (c))
+                    token += c;
+                else
+                    flush();
+            }
+            flush();
+
+            return tokens;
+        }
+
+        bool passesFilters (const Entry& entry, const Query& query) const {
+            const auto& description = entry.description;
+            if (query.manufacturer.isNotEmpty() && !description.manufacturerName.equalsIgnoreCase (query.manufacturer))
+                return false;
+            if (query.format.isNotEmpty() && description.pluginFormatName != query.format) return false;
+            if (query.isInstrument && description.isInstrument != *query.isInstrument) return false;
+            if (query.category.isNotEmpty()
+                && !description.category.equalsIgnoreCase (query.category)
+                && !juce::StringArray::fromTokens (description.category, "|", "").contains (query.category, true))
+                return false;
+
+            return true;
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginCatalog)
+    };
+}
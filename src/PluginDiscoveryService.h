@@ -0,0 +1,249 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <atomic>
+#include <map>
+
+#if JUCE_LINUX
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <sys/resource.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#elif JUCE_MAC
+    #include <sys/resource.h>
+#endif
+
+namespace timeoffaudio {
+    /*
+        Keeps a KnownPluginList up to date in the background, so that users never need to run a full rescan.
+
+        A low priority thread watches the default search paths of every format that can scan for plugins (with
+        inotify on Linux, and by polling them on other platforms). When something changes, it lists the plugin files
+        again and compares their modification times with the last listing:
+        - New or modified files get (re)scanned, through the list's custom scanner (i.e. the scanner subprocess) if
+          it has one, and their plugins streamed to onPluginsDiscovered.
+        - The plugins of deleted files get removed from the list.
+        Files new to the listing only get scanned if they aren't up to date in the list, which on start picks up
+        plugins installed while the app wasn't running.
+
+        The thread runs at background CPU priority and idle I/O priority. Scanner subprocesses get launched from it
+        and inherit both on Linux. Discovery can be paused, i.e. while PluginHost runs an explicit scan, and catches
+        up on changes once resumed.
+    */
+    class PluginDiscoveryService final : private juce::Thread {
+    public:
+        using PluginsDiscoveredCallback = std::function<void (const juce::Array<juce::PluginDescription>& plugins)>;
+
+        struct Options {
+            int pollIntervalMs = 30000; // How often to look for changes, where file system events aren't available
+            int settleMs       = 2000;  // How long to wait for installers to finish writing before scanning
+        };
+
+        PluginDiscoveryService (juce::KnownPluginList& knownPluginList,
+            juce::Array<juce::AudioPluginFormat*> formatsToWatch,
+            PluginsDiscoveredCallback oPD,
+            Options discoveryOptions = {})
+            : juce::Thread ("pluginDiscovery"),
+              list (knownPluginList),
+              onPluginsDiscovered (std::move (oPD)),
+              options (discoveryOptions) {
+            for (auto* format : formatsToWatch)
+                if (format->canScanForPlugins()) formats.add (format);
+
+            startThread (juce::Thread::Priority::background);
+        }
+
+        ~PluginDiscoveryService() override {
+            signalThreadShouldExit();
+            notify();
+            stopThread (10000);
+        }
+
+        void setPaused (const bool shouldBePaused) {
+            paused = shouldBePaused;
+            if (!shouldBePaused) notify();
+        }
+
+        bool isPaused() const { return paused; }
+
+    private:
+        juce::KnownPluginList& list;
+        juce::Array<juce::AudioPluginFormat*> formats;
+        PluginsDiscoveredCallback onPluginsDiscovered;
+        const Options options;
+
+        std::atomic<bool> paused { false };
+        bool hasPendingChanges = true; // Start with a full listing
+
+        // Modification times of the plugin files of each format, as of the last listing
+        std::map<juce::String, std::map<juce::String, juce::int64>> listings;
+
+#if JUCE_LINUX
+        int inotifyFd = -1;
+        juce::Array<int> watchDescriptors;
+#endif
+
+        void run() override {
+            lowerPriority();
+            openWatcher();
+
+            while (!threadShouldExit()) {
+                if (hasPendingChanges && !paused) {
+                    hasPendingChanges = false;
+                    updateWatches();
+                    discover();
+                }
+
+                hasPendingChanges |= waitForChanges();
+                if (hasPendingChanges && !threadShouldExit()) {
+                    // Let installers finish writing, and fold their events into a single listing
+                    wait (options.settleMs);
+                    drainEvents();
+                }
+            }
+
+            closeWatcher();
+        }
+
+        void discover() {
+            for (auto* format : formats) {
+                auto& listing = listings[format->getName()];
+
+                std::map<juce::String, juce::int64> newListing;
+                for (const auto& fileOrIdentifier :
+                    format->searchPathsForPlugins (format->getDefaultLocationsToSearch(), true, true))
+                    newListing[fileOrIdentifier] = getModificationTime (fileOrIdentifier);
+
+                for (const auto& [fileOrIdentifier, _] : listing)
+                    if (!newListing.contains (fileOrIdentifier)) removeTypesFor (fileOrIdentifier);
+
+                for (const auto& [fileOrIdentifier, modificationTime] : newListing) {
+                    if (threadShouldExit() || paused) {
+                        // Keep the files that weren't looked at yet for the next round
+                        hasPendingChanges = true;
+                        return;
+                    }
+
+                    // Files that are new to the listing only get scanned if the list doesn't know them already
+                    const auto previous    = listing.find (fileOrIdentifier);
+                    const auto wasModified = previous != listing.end() && previous->second != modificationTime;
+                    const auto isNew       = previous == listing.end();
+
+                    listing[fileOrIdentifier] = modificationTime;
+                    if (wasModified || (isNew && !list.isListingUpToDate (fileOrIdentifier, *format)))
+                        scan (*format, fileOrIdentifier, wasModified);
+                }
+
+                listing = std::move (newListing);
+            }
+
+            // Lets the custom scanner shut its worker process down until the next change
+            list.scanFinished();
+        }
+
+        void scan (juce::AudioPluginFormat& format, const juce::String& fileOrIdentifier, const bool wasModified) {
+            // A modified plugin deserves another chance
+            if (wasModified) list.removeFromBlacklist (fileOrIdentifier);
+            if (list.getBlacklistedFiles().contains (fileOrIdentifier)) return;
+
+            juce::OwnedArray<juce::PluginDescription> typesFound;
+            list.scanAndAddFile (fileOrIdentifier, false, typesFound, format);
+            if (typesFound.isEmpty() || !onPluginsDiscovered) return;
+
+            juce::Array<juce::PluginDescription> discovered;
+            for (const auto* type : typesFound) discovered.add (*type);
+            onPluginsDiscovered (discovered);
+        }
+
+        void removeTypesFor (const juce::String& fileOrIdentifier) {
+            for (const auto& type : list.getTypes())
+                if (type.fileOrIdentifier == fileOrIdentifier) list.removeType (type);
+        }
+
+        static juce::int64 getModificationTime (const juce::String& fileOrIdentifier) {
+            if (!juce::File::isAbsolutePath (fileOrIdentifier)) return 0;
+            return juce::File (fileOrIdentifier).getLastModificationTime().toMilliseconds();
+        }
+
+        static void lowerPriority() {
+#if JUCE_LINUX
+            // Idle I/O class (IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) for this thread (IOPRIO_WHO_PROCESS, tid)
+            constexpr int ioprioWhoProcess = 1, ioprioClassIdle = 3, ioprioClassShift = 13;
+            const auto threadId = (int) syscall (SYS_gettid);
+            syscall (SYS_ioprio_set, ioprioWhoProcess, threadId, ioprioClassIdle << ioprioClassShift);
+            setpriority (PRIO_PROCESS, (id_t) threadId, 19);
+#elif JUCE_MAC
+            setiopolicy_np (IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, IOPOL_THROTTLE);
+#endif
+        }
+
+#if JUCE_LINUX
+        void openWatcher() { inotifyFd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC); }
+
+        void closeWatcher() {
+            if (inotifyFd >= 0) close (inotifyFd);
+            inotifyFd = -1;
+        }
+
+        // Watches the search paths and the folders inside them, but not the insides of plugin bundles
+        void updateWatches() {
+            if (inotifyFd < 0) return;
+
+            for (const auto watchDescriptor : watchDescriptors) inotify_rm_watch (inotifyFd, watchDescriptor);
+            watchDescriptors.clearQuick();
+
+            constexpr uint32_t mask =
+                IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+            const std::function<void (const juce::File&, int)> watch = [&] (const juce::File& folder, int depth) {
+                const auto watchDescriptor = inotify_add_watch (inotifyFd, folder.getFullPathName().toRawUTF8(), mask);
+                if (watchDescriptor >= 0) watchDescriptors.add (watchDescriptor);
+
+                if (depth <= 0) return;
+                for (const auto& entry :
+                    juce::RangedDirectoryIterator (folder, false, "*", juce::File::findDirectories))
+                    if (!isPluginBundle (entry.getFile())) watch (entry.getFile(), depth - 1);
+            };
+
+            for (auto* format : formats)
+                for (const auto& folder : format->getDefaultLocationsToSearch().getFolders()) watch (folder, 4);
+        }
+
+        bool isPluginBundle (const juce::File& file) const {
+            for (auto* format : formats)
+                if (format->fileMightContainThisPluginType (file.getFullPathName())) return true;
+            return false;
+        }
+
+        // Returns true if something changed before the thread got notified (i.e. resumed or stopped)
+        bool waitForChanges() {
+            if (inotifyFd < 0) return !wait (options.pollIntervalMs);
+
+            // Poll in short steps, so that notify() (from setPaused and the destructor) is picked up
+            while (!threadShouldExit()) {
+                pollfd fd { inotifyFd, POLLIN, 0 };
+                if (poll (&fd, 1, 100) > 0) return true;
+                if (wait (0)) return false;
+            }
+
+            return false;
+        }
+
+        void drainEvents() {
+            if (inotifyFd < 0) return;
+
+            alignas (inotify_event) char buffer[4096];
+            while (read (inotifyFd, buffer, sizeof (buffer)) > 0) {}
+        }
+#else
+        void openWatcher() {}
+        void closeWatcher() {}
+        void updateWatches() {}
+        bool waitForChanges() { return !wait (options.pollIntervalMs); }
+        void drainEvents() {}
+#endif
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginDiscoveryService)
+    };
+}
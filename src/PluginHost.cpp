@@ -7,33 +7,36 @@
 #include "choc/containers/choc_Value.h"
 
 namespace timeoffaudio {
-    PluginHost::PluginHost (juce::File pLF, ConnectionsRefreshFn cF, GetEnabledParameterFn gEF)
-        : pluginListFile (pLF), getConnectionsFor (cF), getEnabledParameterFor (gEF) {
+    PluginHost::PluginHost (juce::File pLF,
+        ConnectionsRefreshFn cF,
+        GetEnabledParameterFn gEF,
+        ConnectionsRefreshFn sCF)
+        : sharedPluginList (SharedPluginCatalog::getFor (pLF,
+              [] {
+                  // TODO: this needs to be lifted outside of PluginHost so that it's customizable per
+                  // plugin and not fixed like it is now
+                  return std::make_unique<timeoffaudio::CustomPluginScanner> (
+                      [] (const juce::PluginDescription& plugin) {
+                          return isHostablePlugin (plugin, JucePlugin_Name);
+                      });
+              })),
+          knownPlugins (sharedPluginList->getList()),
+          pluginListFile (pLF),
+          getConnectionsFor (cF),
+          getEnabledParameterFor (gEF),
+          getSidechainConnectionsFor (sCF) {
+        // The message thread keeps its own reference to the initial snapshot too, so that replacing it on the realtime
+        // thread doesn't free it there
+        realtimeSafePlugins.graph = std::make_shared<const RealtimePluginGraph>();
+        deallocationCopyPlugins   = realtimeSafePlugins;
         startTimerHz (120);
-        // TODO: this needs to be lifted outside of PluginHost so that it's customizable per
-        // plugin and not fixed like it is now
-        knownPlugins.setCustomScanner (
-            std::make_unique<timeoffaudio::CustomPluginScanner> ([] (const juce::PluginDescription& plugin) {
-                if (plugin.isInstrument) return false;
-                if (plugin.name == JucePlugin_Name) return false;
-                // Add other exclusions here
-
-                return true;
-            }));
-
-        if (pluginListFile.exists()) {
-            if (auto savedPluginList = juce::parseXML (pluginListFile.loadFileAsString()))
-                knownPlugins.recreateFromXml (*savedPluginList);
-            else
-                PluginHost::changeListenerCallback (&knownPlugins);
-        } else
-            PluginHost::changeListenerCallback (&knownPlugins);
 
         formatManager.addFormat (new juce::VST3PluginFormat());
 #if JUCE_MAC
         formatManager.addFormat (new juce::AudioUnitPluginFormat());
 #endif
-        knownPlugins.addChangeListener (this);
+        sharedPluginList->addListener (this);
+        telemetry.addSink (std::make_unique<AnalyticsTelemetrySink>());
     }
 
     PluginHost::~PluginHost() {
@@ -42,29 +45,38 @@ namespace timeoffaudio {
 
         stopTimer();
         abortOngoingScan();
+        discoveryService.reset();
+
+        // The pipeline flushes whatever is still queued once it's destroyed
+        for (auto& pending : pendingLoadEvents) telemetry.log (std::move (pending.event));
 
-        knownPlugins.removeChangeListener (this);
-        for (auto& [_, pluginBox] : nonRealtimeSafePlugins) {
-            pluginBox.get().instance->removeListener (this);
+        sharedPluginList->removeListener (this);
+        instanceListeners.clear();
+        for (auto& [_, pluginBox] : nonRealtimeSafePlugins)
             if (const auto pluginWindow = pluginBox->window) pluginWindow->removeComponentListener (this);
-        }
     }
 
     juce::Array<juce::AudioPluginFormat*> PluginHost::getFormats() const { return formatManager.getFormats(); }
 
+    void PluginHost::addFormat (std::unique_ptr<juce::AudioPluginFormat> format) {
+        formatManager.addFormat (format.release());
+    }
+
     juce::Array<juce::PluginDescription> PluginHost::getAvailablePlugins() const { return knownPlugins.getTypes(); }
 
+    PluginCatalog::Results PluginHost::searchAvailablePlugins (const PluginCatalog::Query& query) const {
+        return sharedPluginList->getCatalog().search (query);
+    }
+
     void PluginHost::deletePluginInstance (KeyType key) {
         withWriteAccess ([&] (TransientPluginMap& pluginMap) { deletePluginInstance (pluginMap, key); });
     }
     void PluginHost::deletePluginInstance (TransientPluginMap& pluginMap, KeyType key) {
+        const auto pluginBox = pluginMap.find (key);
+        if (!pluginBox) return;
+
         // Before deleting a plugin, we first re-enable its plugin parameter
-        pluginMap.update (key, [&] (auto pluginBox) {
-            return pluginBox.update ([&] (auto plugin) {
-                plugin.enabledParameter->setValue (1.f);
-                return plugin;
-            });
-        });
+        (*pluginBox)->enabledParameter->setValue (1.f);
         pluginMap.erase (key);
     }
 
@@ -74,51 +86,59 @@ namespace timeoffaudio {
 
     void PluginHost::movePluginInstance (TransientPluginMap& pluginMap, KeyType fromKey, KeyType toKey) {
         if (fromKey == toKey) return;
-        if (!pluginMap.find (fromKey)) return;
-
-        auto fromPluginEnabled = pluginMap[fromKey]->enabledParameter->getValue();
-
-        if (pluginMap.find (toKey)) {
-            // Swap the plugin instances and windows, if the destination key is already in use
-            // Make sure to preserve the linked params by key, and only swap their values
-            const auto toPluginBox = pluginMap[toKey];
-            auto toPluginEnabled   = toPluginBox->enabledParameter->getValue();
-
-            pluginMap.update (toKey, [&] (auto pluginBox) {
-                return pluginBox.update ([&] (auto plugin) {
-                    plugin.instance = pluginMap[fromKey]->instance;
-                    plugin.window   = pluginMap[fromKey]->window;
-                    plugin.window->setPluginInstanceKey (toKey);
-                    plugin.enabledParameter = getEnabledParameterFor (toKey);
-                    plugin.enabledParameter->setValue (fromPluginEnabled);
-                    return plugin;
-                });
-            });
 
-            pluginMap.update (fromKey, [&] (auto pluginBox) {
-                return pluginBox.update ([&] (auto plugin) {
-                    plugin.instance = toPluginBox->instance;
-                    plugin.window   = toPluginBox->window;
-                    plugin.window->setPluginInstanceKey (fromKey);
-                    plugin.enabledParameter = getEnabledParameterFor (fromKey);
-                    plugin.enabledParameter->setValue (toPluginEnabled);
-                    return plugin;
-                });
-            });
+        // Look each key up once, and work on copies of the boxes from there
+        const auto fromPluginBox = pluginMap.find (fromKey);
+        if (!fromPluginBox) return;
+
+        const auto movedPluginBox = *fromPluginBox;
+        auto fromPluginEnabled    = movedPluginBox->enabledParameter->getValue();
+
+        if (const auto toPluginBox = pluginMap.find (toKey)) {
+            // Swap the plugin instances and windows (along with their processing state and options), if the destination
+            // key is already in use
+            // Make sure to preserve the linked params (and handles) by key, and only swap their values
+            const auto swappedPluginBox = *toPluginBox;
+            auto toPluginEnabled        = swappedPluginBox->enabledParameter->getValue();
+
+            pluginMap.set (toKey, swappedPluginBox.update ([&] (auto plugin) {
+                plugin.instance          = movedPluginBox->instance;
+                plugin.window            = movedPluginBox->window;
+                plugin.bypassParameter   = movedPluginBox->bypassParameter;
+                plugin.processingState   = movedPluginBox->processingState;
+                plugin.processingOptions = movedPluginBox->processingOptions;
+                plugin.outgoing          = movedPluginBox->outgoing;
+                if (plugin.window) plugin.window->setPluginInstanceKey (toKey);
+                plugin.enabledParameter = getEnabledParameterFor (toKey);
+                plugin.enabledParameter->setValue (fromPluginEnabled);
+                return plugin;
+            }));
+
+            pluginMap.set (fromKey, movedPluginBox.update ([&] (auto plugin) {
+                plugin.instance          = swappedPluginBox->instance;
+                plugin.window            = swappedPluginBox->window;
+                plugin.bypassParameter   = swappedPluginBox->bypassParameter;
+                plugin.processingState   = swappedPluginBox->processingState;
+                plugin.processingOptions = swappedPluginBox->processingOptions;
+                plugin.outgoing          = swappedPluginBox->outgoing;
+                if (plugin.window) plugin.window->setPluginInstanceKey (fromKey);
+                plugin.enabledParameter = getEnabledParameterFor (fromKey);
+                plugin.enabledParameter->setValue (toPluginEnabled);
+                return plugin;
+            }));
         } else {
             // If the destination key is free,
-            // move the plugin instance and window to the destination key, and clear the source key
-            pluginMap.update (toKey, [&] (auto pluginBox) {
-                return pluginBox.update ([&] (auto plugin) {
-                    plugin.instance = pluginMap[fromKey]->instance;
-                    plugin.window   = pluginMap[fromKey]->window;
-                    plugin.window->setPluginInstanceKey (toKey);
-                    plugin.enabledParameter = getEnabledParameterFor (toKey);
-                    plugin.enabledParameter->setValue (fromPluginEnabled);
-                    return plugin;
-                });
-            });
-
+            // move the plugin instance and window (along with its processing state) to the destination key, and
+            // clear the source key
+            pluginMap.set (toKey, movedPluginBox.update ([&] (auto plugin) {
+                if (plugin.window) plugin.window->setPluginInstanceKey (toKey);
+                plugin.enabledParameter = getEnabledParameterFor (toKey);
+                plugin.enabledParameter->setValue (fromPluginEnabled);
+                plugin.connections          = {};
+                plugin.sidechainConnections = {};
+                plugin.handle               = keyTable.intern (toKey);
+                return plugin;
+            }));
             pluginMap.erase (fromKey);
         }
     }
@@ -128,83 +148,501 @@ namespace timeoffaudio {
         const KeyType key,
         timeoffaudio::PluginWindow::Options windowOptions,
         const juce::MemoryBlock& initialState) {
+        TIMEOFFAUDIO_TRACE_SCOPE_WITH_DETAIL ("host", "createPluginInstance", pluginDescription.name);
+        const auto lookupStartTicks = juce::Time::getHighResolutionTicks();
         for (auto format : formatManager.getFormats()) {
             if (format->getName() == pluginDescription.pluginFormatName) {
+                auto logParameters = getLoadTelemetryParameters (pluginDescription, key);
+                logParameters.set ("description_lookup_ms", getMillisecondsSince (lookupStartTicks));
+
                 juce::String errorMessage;
-                juce::StringPairArray logParameters;
-                std::unique_ptr<juce::AudioPluginInstance> instance =
-                    format->createInstanceFromDescription (pluginDescription, sampleRate, blockSize, errorMessage);
+                const auto instantiationStartTicks = juce::Time::getHighResolutionTicks();
+                auto instance = instantiatePlugin (*format, pluginDescription, errorMessage);
+                logParameters.set ("instantiation_ms", getMillisecondsSince (instantiationStartTicks));
 
                 if (errorMessage.isNotEmpty() || !instance) {
-                    const juce::ScopedReadLock lock (listenersLock);
                     logParameters.set ("success", "false");
                     logParameters.set ("error_message", errorMessage);
+                    telemetry.log ({ "plugin_load", logParameters });
                     listeners.call (&Listener::pluginInstanceLoadFailed, key, errorMessage.toStdString());
                     return;
                 }
 
                 logParameters.set ("success", "true");
-                logParameters.set ("loaded_plugin_name", pluginDescription.descriptiveName);
-                logParameters.set ("loaded_plugin_version", pluginDescription.version);
-                logParameters.set ("loaded_plugin_format", pluginDescription.pluginFormatName);
-                logParameters.set ("loaded_plugin_manufacturer", pluginDescription.manufacturerName);
-                logParameters.set ("key", key);
 
                 // Plugin setup
                 instance->enableAllBuses();
+                const auto prepareStartTicks = juce::Time::getHighResolutionTicks();
                 instance->prepareToPlay (sampleRate, blockSize);
+                logParameters.set ("prepare_ms", getMillisecondsSince (prepareStartTicks));
                 if (playhead) instance->setPlayHead (playhead);
+
+                const auto stateRestoreStartTicks = juce::Time::getHighResolutionTicks();
                 if (!initialState.isEmpty())
                     instance->setStateInformation (initialState.getData(), (int) initialState.getSize());
-                instance->addListener (this);
+                logParameters.set ("state_restore_ms", getMillisecondsSince (stateRestoreStartTicks));
+                logParameters.set ("state_bytes", juce::String ((juce::int64) initialState.getSize()));
 
-                pluginMap.set (key, immer::box<Plugin> (std::move (instance), nullptr, getEnabledParameterFor (key)));
-                if (windowOptions.openAutomatically) openPluginWindow (pluginMap, key, windowOptions);
+                // Recently used plugins get scanned first next time
+                auto& recentlyUsedPlugins = scanPriorities.recentlyUsedPlugins;
+                recentlyUsedPlugins.removeString (pluginDescription.fileOrIdentifier);
+                recentlyUsedPlugins.insert (0, pluginDescription.fileOrIdentifier);
+                recentlyUsedPlugins.removeRange (MAX_RECENTLY_USED_PLUGINS, recentlyUsedPlugins.size());
+
+                Plugin plugin (std::move (instance), nullptr, getEnabledParameterFor (key), keyTable.intern (key));
+                plugin.processingState->prepare (*plugin.instance, sampleRate, blockSize, midiLimits);
+                logPluginLoad ({ "plugin_load", logParameters }, plugin.processingState);
 
-                juce::Analytics::getInstance()->logEvent ("plugin_load", logParameters);
+                pluginMap.set (key, immer::box<Plugin> (std::move (plugin)));
+                if (windowOptions.openAutomatically) openPluginWindow (pluginMap, key, windowOptions);
 
                 break;
             }
         }
     }
 
-    void PluginHost::startScan (const juce::String& format) {
+    juce::StringPairArray PluginHost::getLoadTelemetryParameters (const juce::PluginDescription& pluginDescription,
+        const KeyType& key) const {
+        juce::StringPairArray logParameters;
+        logParameters.set ("loaded_plugin_name", pluginDescription.descriptiveName);
+        logParameters.set ("loaded_plugin_version", pluginDescription.version);
+        logParameters.set ("loaded_plugin_format", pluginDescription.pluginFormatName);
+        logParameters.set ("loaded_plugin_manufacturer", pluginDescription.manufacturerName);
+        logParameters.set ("sandboxed", sandboxPlugins ? "true" : "false");
+        logParameters.set ("key", key);
+        return logParameters;
+    }
+
+    juce::String PluginHost::getMillisecondsSince (const juce::int64 startTicks) {
+        const auto elapsedTicks = juce::Time::getHighResolutionTicks() - startTicks;
+        return juce::String (juce::Time::highResolutionTicksToSeconds (elapsedTicks) * 1000.0, 3);
+    }
+
+    void PluginHost::addTelemetrySink (std::unique_ptr<TelemetrySink> sink) { telemetry.addSink (std::move (sink)); }
+
+    void PluginHost::logPluginLoad (TelemetryEvent event,
+        const std::shared_ptr<PluginProcessingState>& processingState) {
+        pendingLoadEvents.push_back ({ std::move (event), processingState, juce::Time::getHighResolutionTicks() });
+    }
+
+    void PluginHost::logLoadsWithFirstBlock() {
+        const auto nowTicks = juce::Time::getHighResolutionTicks();
+
+        std::erase_if (pendingLoadEvents, [&] (PendingLoadEvent& pending) {
+            const auto processingState = pending.processingState.lock();
+            juce::int64 startTicks = 0, elapsedTicks = 0;
+
+            if (processingState && processingState->getFirstBlock (startTicks, elapsedTicks)) {
+                const auto millis = [] (const juce::int64 ticks) {
+                    return juce::String (juce::Time::highResolutionTicksToSeconds (ticks) * 1000.0, 3);
+                };
+                pending.event.parameters.set ("first_block_ms", millis (elapsedTicks));
+                pending.event.parameters.set ("time_to_first_block_ms", millis (startTicks - pending.loadedTicks));
+            } else if (processingState
+                       && juce::Time::highResolutionTicksToSeconds (nowTicks - pending.loadedTicks)
+                              < MAX_FIRST_BLOCK_WAIT_SECONDS) {
+                return false;
+            }
+
+            // Plugins that were deleted (or never processed) before their first block are logged without it
+            telemetry.log (std::move (pending.event));
+            return true;
+        });
+    }
+
+    std::unique_ptr<juce::AudioPluginInstance> PluginHost::instantiatePlugin (juce::AudioPluginFormat& format,
+        const juce::PluginDescription& pluginDescription,
+        juce::String& errorMessage) {
+        if (sandboxPlugins)
+            return SandboxedPluginInstance::create (pluginDescription,
+                sampleRate,
+                blockSize,
+                errorMessage,
+                [this] (SandboxedPluginInstance& crashedInstance) { sandboxCrashed (crashedInstance); });
+
+        return format.createInstanceFromDescription (pluginDescription, sampleRate, blockSize, errorMessage);
+    }
+
+    void PluginHost::hotSwapPluginInstance (const KeyType& key,
+        const juce::PluginDescription& pluginDescription,
+        const juce::MemoryBlock& state,
+        const int crossfadeSamples) {
+        assertMessageThread();
+        TIMEOFFAUDIO_TRACE_SCOPE_WITH_DETAIL ("host", "hotSwapPluginInstance", pluginDescription.name);
+
+        const auto pluginBox = nonRealtimeSafePlugins.find (key);
+        if (!pluginBox) return;
+
+        auto logParameters          = getLoadTelemetryParameters (pluginDescription, key);
+        const auto lookupStartTicks = juce::Time::getHighResolutionTicks();
+        juce::String errorMessage   = "No format found for " + pluginDescription.pluginFormatName;
+        std::unique_ptr<juce::AudioPluginInstance> instance;
+        for (auto format : formatManager.getFormats()) {
+            if (format->getName() != pluginDescription.pluginFormatName) continue;
+
+            logParameters.set ("description_lookup_ms", getMillisecondsSince (lookupStartTicks));
+            errorMessage.clear();
+            const auto instantiationStartTicks = juce::Time::getHighResolutionTicks();
+            instance = instantiatePlugin (*format, pluginDescription, errorMessage);
+            logParameters.set ("instantiation_ms", getMillisecondsSince (instantiationStartTicks));
+            break;
+        }
+
+        if (errorMessage.isNotEmpty() || !instance) {
+            logParameters.set ("success", "false");
+            logParameters.set ("error_message", errorMessage);
+            telemetry.log ({ "plugin_hot_swap", logParameters });
+            listeners.call (&Listener::pluginInstanceLoadFailed, key, errorMessage.toStdString());
+            return;
+        }
+
+        logParameters.set ("success", "true");
+
+        // Set up like the instance it replaces, which keeps playing meanwhile
+        const auto& outgoingPlugin = pluginBox->get();
+        Plugin plugin (std::move (instance), nullptr, outgoingPlugin.enabledParameter, outgoingPlugin.handle);
+        plugin.connections          = outgoingPlugin.connections;
+        plugin.sidechainConnections = outgoingPlugin.sidechainConnections;
+        plugin.processingOptions    = outgoingPlugin.processingOptions;
+
+        plugin.instance->enableAllBuses();
+        const auto prepareStartTicks = juce::Time::getHighResolutionTicks();
+        preparePlugin (plugin);
+        logParameters.set ("prepare_ms", getMillisecondsSince (prepareStartTicks));
+        if (playhead) plugin.instance->setPlayHead (playhead);
+
+        const auto stateRestoreStartTicks = juce::Time::getHighResolutionTicks();
+        if (!state.isEmpty()) plugin.instance->setStateInformation (state.getData(), (int) state.getSize());
+        logParameters.set ("state_restore_ms", getMillisecondsSince (stateRestoreStartTicks));
+        logParameters.set ("state_bytes", juce::String ((juce::int64) state.getSize()));
+        logPluginLoad ({ "plugin_hot_swap", logParameters }, plugin.processingState);
+
+        // The outgoing plugin (along with whatever it was still crossfading from) stays alive through the new one
+        const auto numChannels = juce::jmax (outgoingPlugin.instance->getTotalNumInputChannels(),
+            outgoingPlugin.instance->getTotalNumOutputChannels());
+        plugin.processingState->prepareCrossfade (
+            { outgoingPlugin.instance.get(), outgoingPlugin.bypassParameter, outgoingPlugin.processingState.get() },
+            numChannels,
+            blockSize,
+            crossfadeSamples);
+        plugin.outgoing = std::make_shared<const Plugin> (outgoingPlugin);
+        ++numHotSwapsInProgress;
+
+        // The outgoing window's editor refers to the outgoing instance, so it goes now, and a window gets re-opened
+        // for the new instance where it was
+        auto windowOptions              = PluginWindow::Options();
+        windowOptions.openAutomatically = false;
+        if (const auto outgoingWindow = outgoingPlugin.window) {
+            windowOptions.openAutomatically = outgoingWindow->isVisible();
+            windowOptions.xPos              = outgoingWindow->getX();
+            windowOptions.yPos              = outgoingWindow->getY();
+
+            outgoingWindow->removeComponentListener (this);
+            outgoingWindow->setVisible (false);
+            outgoingWindow->clearContentComponent();
+        }
+
+        const auto previousLatency = getLatencySamples (key);
+        withWriteAccess ([&] (TransientPluginMap& pluginMap) {
+            pluginMap.set (key, immer::box<Plugin> (std::move (plugin)));
+            if (windowOptions.openAutomatically) openPluginWindow (pluginMap, key, windowOptions);
+        });
+
+        if (getLatencySamples (key) != previousLatency) listeners.call (&Listener::latenciesChanged);
+    }
+
+    void PluginHost::hotSwapPluginState (const KeyType& key,
+        const juce::MemoryBlock& state,
+        const int crossfadeSamples) {
+        assertMessageThread();
+
+        if (const auto pluginBox = nonRealtimeSafePlugins.find (key))
+            hotSwapPluginInstance (key, (*pluginBox)->instance->getPluginDescription(), state, crossfadeSamples);
+    }
+
+    void PluginHost::releaseFinishedHotSwaps() {
+        numHotSwapsInProgress = 0;
+        std::vector<KeyType> finishedKeys;
+        for (const auto& [key, pluginBox] : nonRealtimeSafePlugins) {
+            if (!pluginBox->outgoing) continue;
+
+            if (pluginBox->processingState->hasCrossfadeFinished())
+                finishedKeys.push_back (key);
+            else
+                ++numHotSwapsInProgress;
+        }
+
+        if (finishedKeys.empty()) return;
+
+        // The realtime thread might still hold snapshots with the outgoing plugins, those get released along with
+        // the snapshots, on this thread
+        withWriteAccess ([&] (TransientPluginMap& pluginMap) {
+            for (const auto& key : finishedKeys)
+                pluginMap.update_if_exists (key, [] (auto pluginBox) {
+                    return pluginBox.update ([] (auto plugin) {
+                        plugin.outgoing = nullptr;
+                        return plugin;
+                    });
+                });
+        });
+    }
+
+    void PluginHost::startScan (const juce::String& format) { startScan (juce::StringArray { format }); }
+
+    void PluginHost::startScan (const juce::StringArray& formats) {
         auto onScanProgress = [this] (float progress01, juce::String formatName, juce::String currentPlugin) {
-            const juce::ScopedReadLock lock (listenersLock);
             listeners.call (&Listener::scanProgressed, progress01, formatName, currentPlugin);
         };
 
-        auto onScanFinished = [this]() {
-            const juce::ScopedReadLock lock (listenersLock);
-            currentScan.reset();
-            listeners.call (&Listener::scanFinished);
+        auto onPluginsDiscovered = [this] (const juce::Array<juce::PluginDescription>& plugins) {
+            listeners.call (&Listener::pluginsDiscovered, plugins);
         };
 
-        for (const auto formatCandidate : formatManager.getFormats())
-            if (formatCandidate->getName() == format && formatCandidate->canScanForPlugins()) {
-                auto failedToLoadPluginsFolder = pluginListFile.getParentDirectory();
+        if (scanPool == nullptr)
+            scanPool = std::make_unique<juce::ThreadPool> (juce::ThreadPoolOptions()
+                                                               .withThreadName ("pluginScan")
+                                                               .withNumberOfThreads (
+                                                                   juce::jlimit (1,
+                                                                       MAX_SCAN_THREADS,
+                                                                       juce::SystemStats::getNumCpus() / 2)));
+
+        for (const auto formatCandidate : formatManager.getFormats()) {
+            const auto formatName = formatCandidate->getName();
+            if (!formats.contains (formatName) || !formatCandidate->canScanForPlugins()) continue;
+            if (currentScans.contains (formatName)) continue;
+
+            auto onScanFinished = [this, formatName]() {
+                // The scan calls this, and destroying it destroys this lambda along with its captures. So everything
+                // below only goes through locals, and the scan is taken out of the map but only destroyed on return.
+                auto* host              = this;
+                const auto finishedName = formatName;
+                auto finishedScan       = host->currentScans.extract (finishedName);
+
+                host->listeners.call (&Listener::formatScanFinished, finishedName);
+                if (!host->currentScans.empty()) return;
+
+                if (host->discoveryService) host->discoveryService->setPaused (false);
+                host->listeners.call (&Listener::scanFinished);
+            };
+
+            // Background discovery would only compete with the scan for the scanner process
+            if (discoveryService) discoveryService->setPaused (true);
+
+            currentScans[formatName] = std::make_unique<timeoffaudio::PluginScan> (knownPlugins,
+                *formatCandidate,
+                *scanPool,
+                pluginListFile.getParentDirectory(),
+                onScanProgress,
+                onScanFinished,
+                onPluginsDiscovered,
+                scanPriorities);
+        }
+    }
+
+    void PluginHost::setBackgroundDiscoveryEnabled (const bool shouldBeEnabled,
+        const PluginDiscoveryService::Options& options) {
+        assertMessageThread();
 
-                currentScan = std::make_unique<timeoffaudio::PluginScan> (
-                    knownPlugins, *formatCandidate, failedToLoadPluginsFolder, onScanProgress, onScanFinished);
-                break;
-            }
+        // Restarting with new options
+        discoveryService.reset();
+        if (!shouldBeEnabled) return;
+
+        discoveryService = std::make_unique<PluginDiscoveryService> (
+            knownPlugins,
+            formatManager.getFormats(),
+            [this] (const juce::Array<juce::PluginDescription>& plugins) {
+                listeners.call (&Listener::pluginsDiscovered, plugins);
+            },
+            options);
+        if (isScanInProgress()) discoveryService->setPaused (true);
+    }
+
+    bool PluginHost::isBackgroundDiscoveryEnabled() const { return discoveryService != nullptr; }
+
+    void PluginHost::setScanPriorities (const PluginScanScheduler::Priorities& priorities) {
+        assertMessageThread();
+        scanPriorities = priorities;
+    }
+
+    PluginScanScheduler::Priorities PluginHost::getScanPriorities() const {
+        assertMessageThread();
+        return scanPriorities;
     }
 
     void PluginHost::abortOngoingScan() const {
-        if (currentScan != nullptr) currentScan->abort();
+        // Aborting a scan removes it from currentScans, so don't iterate the map itself
+        juce::StringArray formatNames;
+        for (const auto& [formatName, _] : currentScans) formatNames.add (formatName);
+
+        for (const auto& formatName : formatNames)
+            if (const auto scan = currentScans.find (formatName); scan != currentScans.end()) scan->second->abort();
     }
 
-    bool PluginHost::isScanInProgress() const { return currentScan != nullptr; }
+    bool PluginHost::isScanInProgress() const { return !currentScans.empty(); }
 
     choc::value::Value PluginHost::getScanStatus() const {
         choc::value::Value status = choc::value::createObject ("PluginScanStatus");
         status.addMember ("inProgress", isScanInProgress());
 
         if (isScanInProgress()) {
-            status.addMember ("format", currentScan->getFormatName().toStdString());
-            status.addMember ("progress", currentScan->getProgress());
-            status.addMember ("currentPlugin", currentScan->getCurrentPlugin().toStdString());
+            // The overall progress weighs each format by its number of plugin files
+            juce::StringArray formatNames;
+            juce::String currentPlugin;
+            auto formats      = choc::value::createEmptyArray();
+            float progress    = 0.f;
+            int numCandidates = 0;
+
+            for (const auto& [formatName, scan] : currentScans) {
+                auto formatStatus = choc::value::createObject ("PluginScanFormatStatus");
+                formatStatus.addMember ("format", formatName.toStdString());
+                formatStatus.addMember ("progress", scan->getProgress());
+                formatStatus.addMember ("currentPlugin", scan->getCurrentPlugin().toStdString());
+                formats.addArrayElement (formatStatus);
+
+                formatNames.add (formatName);
+                progress += scan->getProgress() * (float) scan->getNumCandidates();
+                numCandidates += scan->getNumCandidates();
+                if (currentPlugin.isEmpty()) currentPlugin = scan->getCurrentPlugin();
+            }
+
+            status.addMember ("format", formatNames.joinIntoString (", ").toStdString());
+            status.addMember ("progress", numCandidates > 0 ? progress / (float) numCandidates : 0.f);
+            status.addMember ("currentPlugin", currentPlugin.toStdString());
+            status.addMember ("formats", formats);
+        }
+
+        return status;
+    }
+
+    void PluginHost::setProcessingProfilerEnabled (const bool shouldBeEnabled) {
+#if TIMEOFFAUDIO_ENABLE_PLUGIN_PROFILER
+        profiler.setEnabled (shouldBeEnabled);
+#else
+        juce::ignoreUnused (shouldBeEnabled);
+#endif
+    }
+
+    choc::value::Value PluginHost::getProcessingStats() {
+        assertMessageThread();
+
+        choc::value::Value stats = choc::value::createObject ("PluginProcessingStats");
+#if TIMEOFFAUDIO_ENABLE_PLUGIN_PROFILER
+        stats.addMember ("enabled", profiler.isEnabled());
+        stats.addMember ("sampleRate", sampleRate);
+        stats.addMember ("blockSize", blockSize);
+
+        auto plugins        = choc::value::createEmptyArray();
+        double totalDspLoad = 0.0;
+
+        for (const auto& [key, pluginBox] : nonRealtimeSafePlugins) {
+            const auto instance    = pluginBox->instance.get();
+            const auto pluginStats = profiler.collect (instance, (double) sampleRate);
+            totalDspLoad += pluginStats.dspLoadPercent;
+
+            auto pluginEntry = choc::value::createObject ("PluginProcessingStat");
+            pluginEntry.addMember ("key", key);
+            pluginEntry.addMember ("name", instance ? instance->getName().toStdString() : std::string());
+            pluginEntry.addMember ("numBlocks", (int64_t) pluginStats.numBlocks);
+            pluginEntry.addMember ("p50Micros", pluginStats.p50Micros);
+            pluginEntry.addMember ("p99Micros", pluginStats.p99Micros);
+            pluginEntry.addMember ("maxMicros", pluginStats.maxMicros);
+            pluginEntry.addMember ("dspLoadPercent", pluginStats.dspLoadPercent);
+            plugins.addArrayElement (pluginEntry);
+        }
+
+        stats.addMember ("plugins", plugins);
+        stats.addMember ("totalDspLoadPercent", totalDspLoad);
+#else
+        stats.addMember ("enabled", false);
+#endif
+
+        return stats;
+    }
+
+    void PluginHost::setBlockDeadlineMonitoringEnabled (const bool shouldBeEnabled) {
+        blockDeadlineMonitor.setEnabled (shouldBeEnabled);
+    }
+
+    void PluginHost::setBlockDeadlineFraction (const double fractionOfBlockDuration) {
+        blockDeadlineMonitor.setDeadlineFraction (fractionOfBlockDuration);
+    }
+
+    void PluginHost::setAutoBypassAfterOverruns (const int numOverruns) {
+        assertMessageThread();
+        autoBypassAfterOverruns = numOverruns;
+        overrunTimesByKey.clear();
+    }
+
+    choc::value::Value PluginHost::getBlockDeadlineStatus() const {
+        assertMessageThread();
+
+        choc::value::Value status = choc::value::createObject ("BlockDeadlineStatus");
+        status.addMember ("enabled", blockDeadlineMonitor.isEnabled());
+        status.addMember ("deadlineFraction", blockDeadlineMonitor.getDeadlineFraction());
+        status.addMember ("numDroppedOverruns", blockDeadlineMonitor.getNumDroppedOverruns());
+
+        auto overruns = choc::value::createEmptyArray();
+        for (const auto& overrun : recentOverruns) {
+            auto overrunEntry = choc::value::createObject ("BlockOverrun");
+            overrunEntry.addMember ("key", overrun.key);
+            overrunEntry.addMember ("pluginMicros", overrun.pluginMicros);
+            overrunEntry.addMember ("blockMicros", overrun.blockMicros);
+            overrunEntry.addMember ("deadlineMicros", overrun.deadlineMicros);
+            overrunEntry.addMember ("timeMs", overrun.time.toMilliseconds());
+            overruns.addArrayElement (overrunEntry);
         }
+        status.addMember ("recentOverruns", overruns);
+
+        // Counted over the last OVERRUN_WINDOW_SECONDS, see forgetOldOverruns
+        auto counts = choc::value::createObject ("OverrunCounts");
+        for (const auto& [key, times] : overrunTimesByKey) counts.addMember (key, (int) times.size());
+        status.addMember ("overrunCounts", counts);
+
+        return status;
+    }
+
+    void PluginHost::setSandboxingEnabled (const bool shouldBeEnabled) {
+        assertMessageThread();
+        sandboxPlugins = shouldBeEnabled && SandboxedPluginInstance::isSupported();
+    }
+
+    bool PluginHost::isSandboxingEnabled() const { return sandboxPlugins; }
+
+    void PluginHost::sandboxCrashed (const SandboxedPluginInstance& crashedInstance) {
+        for (const auto& [key, pluginBox] : nonRealtimeSafePlugins)
+            if (pluginBox->instance.get() == &crashedInstance) {
+                listeners.call (&Listener::pluginInstanceCrashed, key);
+                return;
+            }
+    }
+
+    void PluginHost::setMidiLimits (const MidiEventArena::Limits& limits) {
+        assertMessageThread();
+        midiLimits = limits;
+    }
+
+    choc::value::Value PluginHost::getMidiStatus() const {
+        assertMessageThread();
+
+        choc::value::Value status = choc::value::createObject ("MidiStatus");
+        status.addMember ("maxEventsPerBlock", midiLimits.maxEventsPerBlock);
+        status.addMember ("maxBytesPerEvent", midiLimits.maxBytesPerEvent);
+        status.addMember ("numDroppedOutputEvents",
+            (int64_t) numDroppedOutputMidiEvents.load (std::memory_order_relaxed));
+
+        auto plugins = choc::value::createObject ("PluginMidiStatus");
+        for (const auto& [key, pluginBox] : nonRealtimeSafePlugins) {
+            if (!pluginBox->processingState) continue;
+
+            const auto& midiArena = pluginBox->processingState->getMidiArena();
+            auto pluginStatus     = choc::value::createObject ("MidiArenaStatus");
+            pluginStatus.addMember ("numDroppedEvents", (int64_t) midiArena.getNumDroppedEvents());
+            pluginStatus.addMember ("numPluginOverflows", (int64_t) midiArena.getNumPluginOverflows());
+            pluginStatus.addMember ("numAdapterDroppedEvents",
+                (int64_t) pluginBox->processingState->getAdapter().getNumDroppedMidiEvents());
+            plugins.addMember (key, pluginStatus);
+        }
+        status.addMember ("plugins", plugins);
 
         return status;
     }
@@ -221,70 +659,341 @@ namespace timeoffaudio {
     }
 
     void PluginHost::addPluginHostListener (Listener* listener) {
-        juce::ScopedWriteLock lock (listenersLock);
         listeners.add (listener);
     }
 
     void PluginHost::removePluginHostListener (Listener* listener) {
-        juce::ScopedWriteLock lock (listenersLock);
         listeners.remove (listener);
     }
 
-    void PluginHost::changeListenerCallback (juce::ChangeBroadcaster* source) {
-        if (source == &knownPlugins) {
-            if (const auto savedPluginList = knownPlugins.createXml()) {
-                auto saveResult = pluginListFile.create();
-                jassert (saveResult.wasOk());
-                auto writeSuccessful = pluginListFile.replaceWithText (savedPluginList->toString());
-                jassert (writeSuccessful);
+    choc::value::Value PluginHost::getListenerDispatchStats() const {
+        auto stats = choc::value::createEmptyArray();
+        for (const auto& listenerStats : listeners.getDispatchStats()) {
+            const auto address = juce::String::toHexString ((juce::pointer_sized_int) listenerStats.listener);
+
+            auto entry = choc::value::createObject ("ListenerDispatchStats");
+            entry.addMember ("listener", address.toStdString());
+            entry.addMember ("type", listenerStats.typeName);
+            entry.addMember ("numDispatches", (int64_t) listenerStats.numDispatches);
+            entry.addMember ("totalMicros", listenerStats.totalMicros);
+            entry.addMember ("maxMicros", listenerStats.maxMicros);
+            stats.addArrayElement (entry);
+        }
+
+        return stats;
+    }
+
+    void PluginHost::pluginListChanged (const juce::Array<juce::PluginDescription>& types,
+        const PluginCatalog::Delta& delta) {
+        // The shared catalog already saved the list and reindexed the plugins that changed
+        listeners.call (&Listener::availablePluginsUpdated, types);
+        if (!delta.isEmpty()) listeners.call (&Listener::availablePluginsChanged, delta);
+    }
+
+    void PluginHost::process (const Plugin& plugin,
+        juce::AudioBuffer<float>& buffer,
+        juce::MidiBuffer& midiMessages) /* context: realtime */ {
+        processInstance (plugin.handle,
+            plugin.instance.get(),
+            plugin.bypassParameter,
+            plugin.processingState.get(),
+            plugin.enabledParameter,
+            buffer,
+            midiMessages);
+    }
+
+    void PluginHost::process (const RealtimePluginGraph& graph,
+        const RealtimePluginGraph::Node node,
+        juce::AudioBuffer<float>& buffer,
+        juce::MidiBuffer& midiMessages) /* context: realtime */ {
+        processInstance (graph.getHandle (node),
+            graph.getInstance (node),
+            graph.getBypassParameter (node),
+            graph.getProcessingState (node),
+            graph.getEnabledParameter (node),
+            buffer,
+            midiMessages);
+    }
+
+    namespace {
+        // Copies (or adds) the source channels into the destination ones, clearing any destination channels left
+        void mixChannels (float* const* destination,
+            const int numDestinationChannels,
+            const float* const* source,
+            const int numSourceChannels,
+            const int numSamples,
+            const bool shouldOverwrite) /* context: realtime */ {
+            for (int channel = 0; channel < numDestinationChannels; ++channel) {
+                if (channel >= numSourceChannels) {
+                    if (shouldOverwrite) juce::FloatVectorOperations::clear (destination[channel], numSamples);
+                } else if (shouldOverwrite) {
+                    juce::FloatVectorOperations::copy (destination[channel], source[channel], numSamples);
+                } else {
+                    juce::FloatVectorOperations::add (destination[channel], source[channel], numSamples);
+                }
             }
+        }
+    }
+
+    void PluginHost::process (const RealtimePluginGraph& graph,
+        juce::AudioBuffer<float>& buffer,
+        juce::MidiBuffer& midiMessages) /* context: realtime */ {
+        using Node = RealtimePluginGraph::Node;
+        if (graph.isEmpty()) return;
+
+        const auto numSamples      = buffer.getNumSamples();
+        const auto numHostChannels = buffer.getNumChannels();
+
+        if (numSamples > graph.getMaxBlockSize()) {
+            // The channel buffers are sized for the block size given to prepare, so fall back to processing the
+            // plugins one after the other, in place
+            jassertfalse;
+            for (Node node = 0; node < graph.size(); ++node) process (graph, node, buffer, midiMessages);
+            return;
+        }
 
-            {
-                const juce::ScopedWriteLock lock (listenersLock);
-                listeners.call (&Listener::availablePluginsUpdated, knownPlugins.getTypes());
+        const auto mixSources = [&] (std::span<const Node> sources,
+                                    float* const* destination,
+                                    const int numDestinationChannels) {
+            for (size_t index = 0; index < sources.size(); ++index)
+                mixChannels (destination,
+                    numDestinationChannels,
+                    graph.getChannels (sources[index]),
+                    (int) graph.getRouting (sources[index]).numMainOutputs,
+                    numSamples,
+                    index == 0);
+        };
+
+        auto hasProcessedHostMidiInPlace = false;
+        for (Node node = 0; node < graph.size(); ++node) {
+            const auto& routing = graph.getRouting (node);
+            const auto channels = graph.getChannels (node);
+            const auto numMainInputs      = (int) routing.numMainInputs;
+            const auto numSidechainInputs = (int) routing.numSidechainInputs;
+
+            // Main input, from the host's buffer if nothing feeds this plugin
+            if (routing.numMainSources == 0)
+                mixChannels (channels,
+                    numMainInputs,
+                    buffer.getArrayOfReadPointers(),
+                    numHostChannels,
+                    numSamples,
+                    true);
+            else if (!routing.aliasesMainInput)
+                mixSources (graph.getMainSources (node), channels, numMainInputs);
+
+            // Sidechain input, silent if nothing feeds it
+            if (routing.numSidechainSources == 0)
+                mixChannels (channels + numMainInputs, numSidechainInputs, nullptr, 0, numSamples, true);
+            else
+                mixSources (graph.getSidechainSources (node), channels + numMainInputs, numSidechainInputs);
+
+            // Output-only channels
+            for (auto channel = numMainInputs + numSidechainInputs; channel < (int) routing.numChannels; ++channel)
+                juce::FloatVectorOperations::clear (channels[channel], numSamples);
+
+            // MIDI, from the host's buffer if nothing feeds this plugin, bounded by the plugin's arena
+            const auto midiArena = graph.getMidiArena (node);
+            if (midiArena && !routing.aliasesMidiInput) {
+                midiArena->clear();
+                if (routing.numMainSources == 0) midiArena->addEvents (midiMessages);
+                for (const auto source : graph.getMainSources (node))
+                    if (const auto sourceArena = graph.getMidiArena (source))
+                        midiArena->addEvents (sourceArena->getBuffer());
             }
+
+            // Plugins without a processing state (and so without an arena) process the host's MIDI in place, as
+            // when processing the plugins one after the other
+            juce::AudioBuffer<float> nodeBuffer (channels, (int) routing.numChannels, numSamples);
+            process (graph, node, nodeBuffer, midiArena ? midiArena->getBuffer() : midiMessages);
+            if (midiArena)
+                midiArena->pluginProcessed();
+            else
+                hasProcessedHostMidiInPlace = true;
+        }
+
+        // Replace the host's buffers with the mix of the graph's outputs. The outputs' MIDI is only copied as far as
+        // the host's MIDI buffer is preallocated (e.g. with ensureSize), the rest gets dropped and counted. What
+        // plugins without an arena left in the host's MIDI buffer is kept.
+        const auto midiCapacityBytes = midiMessages.data.getNumAllocated();
+        buffer.clear();
+        if (!hasProcessedHostMidiInPlace) midiMessages.clear();
+        for (Node node = 0; node < graph.size(); ++node) {
+            const auto& routing = graph.getRouting (node);
+            if (!routing.isOutput) continue;
+
+            const auto channels = graph.getChannels (node);
+            for (int channel = 0; channel < juce::jmin (numHostChannels, (int) routing.numMainOutputs); ++channel)
+                buffer.addFrom (channel, 0, channels[channel], numSamples);
+
+            if (const auto midiArena = graph.getMidiArena (node))
+                if (const auto numDropped = MidiEventArena::addEventsWithinCapacity (
+                        midiMessages, midiArena->getBuffer(), midiCapacityBytes);
+                    numDropped > 0)
+                    numDroppedOutputMidiEvents.fetch_add ((uint64_t) numDropped, std::memory_order_relaxed);
         }
     }
 
-    void PluginHost::process (const Plugin& plugin,
+    void PluginHost::processInstance (const PluginHandle handle,
+        juce::AudioPluginInstance* instance,
+        juce::AudioProcessorParameter* bypassParameter,
+        PluginProcessingState* processingState,
+        const juce::RangedAudioParameter* enabledParameter,
         juce::AudioBuffer<float>& buffer,
         juce::MidiBuffer& midiMessages) /* context: realtime */ {
-        const auto instance = plugin.instance.get();
+        const auto startTicks = juce::Time::getHighResolutionTicks();
 
-        if (const auto bypassParameter = instance->getBypassParameter(); !bypassParameter) {
-            // When getBypassParameter() returns a nullptr, we need to bypass the plugin
-            // by calling processBlockBypassed
-            instance->processBlockBypassed (buffer, midiMessages);
-        } else {
-            // When getBypassParameter() returns a valid pointer, we need to
-            // set the bypass parameter, and process the plugin normally via processBlock
+        processHotSwappable (instance, bypassParameter, processingState, enabledParameter, buffer, midiMessages);
+
+        // The outgoing instance of a hot swap counts towards the new one
+        const auto elapsedTicks = juce::Time::getHighResolutionTicks() - startTicks;
+        blockDeadlineMonitor.pluginProcessed (handle, instance, elapsedTicks);
+        if (processingState) processingState->recordFirstBlock (startTicks, elapsedTicks);
+#if TIMEOFFAUDIO_ENABLE_PLUGIN_PROFILER
+        if (profiler.isEnabled()) profiler.record (instance, elapsedTicks, buffer.getNumSamples());
+#endif
+    }
 
-            // For safety, let's check that we have defined an "enabled parameter" from the host application/plugin
-            if (plugin.enabledParameter) {
-                const bool isEnabled = plugin.enabledParameter->getValue() >= 0.5f;
-                bypassParameter->setValue (!isEnabled);
+    void PluginHost::processHotSwappable (juce::AudioPluginInstance* instance,
+        juce::AudioProcessorParameter* bypassParameter,
+        PluginProcessingState* processingState,
+        const juce::RangedAudioParameter* enabledParameter,
+        juce::AudioBuffer<float>& buffer,
+        juce::MidiBuffer& midiMessages) /* context: realtime */ {
+        const auto processPlugin = [&] (juce::AudioBuffer<float>& pluginBuffer, juce::MidiBuffer& pluginMidiMessages) {
+            if (!bypassParameter) {
+                // When getBypassParameter() returns a nullptr, we need to bypass the plugin
+                // by calling processBlockBypassed
+                instance->processBlockBypassed (pluginBuffer, pluginMidiMessages);
             } else {
-                jassertfalse;
+                // When getBypassParameter() returns a valid pointer, we need to
+                // set the bypass parameter, and process the plugin normally via processBlock
+                // The processing state only writes the bypass parameter when the enabled state changes, and
+                // crossfades between the dry and processed audio when it does
+
+                // For safety, let's check that we have defined an "enabled parameter" from the host application/plugin
+                jassert (enabledParameter);
+                const bool isEnabled = !enabledParameter || enabledParameter->getValue() >= 0.5f;
+
+                if (processingState) {
+                    processingState->process (*instance, *bypassParameter, isEnabled, pluginBuffer, pluginMidiMessages);
+                } else {
+                    bypassParameter->setValue (!isEnabled);
+                    instance->processBlock (pluginBuffer, pluginMidiMessages);
+                }
             }
+        };
 
-            instance->processBlock (buffer, midiMessages);
-        }
+        // Plugins with a processing adapter get rebuffered and/or oversampled blocks
+        const auto processAdapted = [&] (juce::AudioBuffer<float>& pluginBuffer, juce::MidiBuffer& pluginMidiMessages) {
+            if (processingState && processingState->getAdapter().isActive())
+                processingState->getAdapter().process (pluginBuffer, pluginMidiMessages, processPlugin);
+            else
+                processPlugin (pluginBuffer, pluginMidiMessages);
+        };
+
+        if (!processingState || !processingState->isCrossfading()) return processAdapted (buffer, midiMessages);
+
+        // The outgoing instance shares the enabled parameter, and could itself still be crossfading
+        processingState->processCrossfade (buffer,
+            midiMessages,
+            processAdapted,
+            [&] (const PluginProcessingState::Crossfade& outgoing,
+                juce::AudioBuffer<float>& outgoingBuffer,
+                juce::MidiBuffer& outgoingMidiMessages) {
+                processHotSwappable (outgoing.instance,
+                    outgoing.bypassParameter,
+                    outgoing.processingState,
+                    enabledParameter,
+                    outgoingBuffer,
+                    outgoingMidiMessages);
+            });
     }
 
     void PluginHost::prepare (const int newSampleRate, const int newBlockSize, juce::AudioPlayHead* newPlayhead) {
+        TIMEOFFAUDIO_TRACE_SCOPE ("host", "prepare");
         sampleRate = newSampleRate;
         blockSize  = newBlockSize;
         playhead   = newPlayhead;
+        blockDeadlineMonitor.prepare (sampleRate, blockSize);
 
-        withWriteAccess ([&] (const PluginHost::TransientPluginMap& pluginMap) {
+        withWriteAccess ([&] (PluginHost::TransientPluginMap& pluginMap) {
+            std::vector<KeyType> hotSwappingKeys;
             for (auto& [key, pluginBox] : pluginMap) {
                 const auto instance = pluginBox.get().instance.get();
 
                 instance->enableAllBuses();
-                instance->prepareToPlay (sampleRate, blockSize);
+                preparePlugin (pluginBox.get());
                 if (playhead) instance->setPlayHead (playhead);
+                if (pluginBox->outgoing) hotSwappingKeys.push_back (key);
             }
+
+            // Outgoing instances of hot swaps aren't prepared again, so cut over to the new ones
+            for (const auto& key : hotSwappingKeys)
+                pluginMap.update_if_exists (key, [] (auto pluginBox) {
+                    pluginBox->processingState->cancelCrossfade();
+                    return pluginBox.update ([] (auto plugin) {
+                        plugin.outgoing = nullptr;
+                        return plugin;
+                    });
+                });
+        });
+    }
+
+    void PluginHost::preparePlugin (const Plugin& plugin) {
+        const auto& options = plugin.processingOptions;
+        plugin.instance->prepareToPlay (
+            options.getPluginSampleRate (sampleRate), options.getPluginBlockSize (blockSize));
+        if (plugin.processingState)
+            plugin.processingState->prepare (*plugin.instance, sampleRate, blockSize, midiLimits, options);
+    }
+
+    void PluginHost::setProcessingOptions (const KeyType& key, const PluginProcessingAdapter::Options& options) {
+        assertMessageThread();
+
+        const auto pluginBox = nonRealtimeSafePlugins.find (key);
+        if (!pluginBox || (*pluginBox)->processingOptions == options) return;
+
+        // Like prepare, this re-prepares the live instance, which is why audio must not be processed meanwhile.
+        // The state is still replaced rather than re-prepared, as the previous snapshot keeps referring to it.
+        const auto previousState   = (*pluginBox)->processingState;
+        const auto previousLatency = getLatencySamples (key);
+        std::shared_ptr<PluginProcessingState> newState;
+
+        withWriteAccess ([&] (TransientPluginMap& pluginMap) {
+            pluginMap.update_if_exists (key, [&] (auto box) {
+                return box.update ([&] (auto plugin) {
+                    plugin.processingOptions = options;
+                    plugin.processingState   = newState = std::make_shared<PluginProcessingState>();
+                    preparePlugin (plugin);
+
+                    // The new state isn't crossfading, so a hot swap in progress cuts over to the new instance, as
+                    // it does in prepare
+                    if (previousState) previousState->cancelCrossfade();
+                    plugin.outgoing = nullptr;
+                    return plugin;
+                });
+            });
         });
+
+        // A load still waiting for its first block now gets it from the new state
+        for (auto& pending : pendingLoadEvents)
+            if (previousState && pending.processingState.lock() == previousState) pending.processingState = newState;
+
+        if (getLatencySamples (key) != previousLatency) listeners.call (&Listener::latenciesChanged);
+    }
+
+    int PluginHost::getLatencySamples (const KeyType& key) const {
+        assertMessageThread();
+
+        const auto pluginBox = nonRealtimeSafePlugins.find (key);
+        if (!pluginBox || !(*pluginBox)->instance) return 0;
+
+        const auto& plugin = pluginBox->get();
+        const auto factor  = plugin.processingOptions.getOversamplingFactor();
+        const auto adapterLatency =
+            plugin.processingState ? plugin.processingState->getAdapter().getLatencySamples() : 0;
+        return (plugin.instance->getLatencySamples() + factor - 1) / factor + adapterLatency;
     }
 
     void PluginHost::openPluginWindow (TransientPluginMap& pluginMap, std::string key, PluginWindow::Options options) {
@@ -296,6 +1005,7 @@ namespace timeoffaudio {
                 } else {
                     plugin.window = std::make_shared<timeoffaudio::PluginWindow> (
                         key, *plugin.instance, timeoffaudio::PluginWindow::Type::normal, options);
+                    plugin.window->setLifecyclePolicy (windowLifecyclePolicy);
                     plugin.window->addComponentListener (this);
                 }
 
@@ -371,6 +1081,14 @@ namespace timeoffaudio {
         });
     }
 
+    void PluginHost::setPluginWindowLifecyclePolicy (const PluginWindow::LifecyclePolicy& policy) {
+        assertMessageThread();
+        windowLifecyclePolicy = policy;
+
+        for (const auto& [key, pluginBox] : nonRealtimeSafePlugins)
+            if (const auto pluginWindow = pluginBox->window) pluginWindow->setLifecyclePolicy (policy);
+    }
+
     choc::value::Value PluginHost::getPluginState (KeyType key, const PluginMap& pluginMap) const {
         auto pluginState = choc::value::createObject ("PluginState");
 
@@ -444,28 +1162,32 @@ namespace timeoffaudio {
 
         withReadonlyAccess ([&] (const PluginMap& pluginMap) {
             // Filter out parameters that start with "midi cc", "internal", or "bypass", etc
-            if (const auto pluginBox = pluginMap.find (key)) {
-                parameters = pluginBox->get().instance->getParameters();
-
-                parameters.removeIf ([] (const juce::AudioProcessorParameter* param) {
-                    for (const auto prefix : { "midi cc", "internal", "bypass", "reserved", "in", "out", "-" })
-                        if (param->getName (1024).toLowerCase().startsWith (prefix)) return true;
-
-                    return false;
-                });
-            }
+            if (const auto pluginBox = pluginMap.find (key))
+                parameters = GenericPluginEditor::getUserFacingParameters (*pluginBox->get().instance);
         });
 
         return parameters;
     }
 
-    juce::AudioProcessorParameter* PluginHost::getParameter (KeyType key, int parameterIndex) const {
-        // TODO: this is not very efficient, but it's the simplest way to get the key
-        // figure out how to get the key from the PluginMap without scanning the whole map
-        const auto pluginBox = nonRealtimeSafePlugins.find (key);
-        if (!pluginBox) return nullptr;
+    PluginHost::PluginHandle PluginHost::getHandle (const KeyType& key) const {
+        assertMessageThread();
+        return keyTable.find (key);
+    }
+
+    const PluginHost::KeyType& PluginHost::getKey (const PluginHandle handle) const {
+        assertMessageThread();
+        return keyTable.getKey (handle);
+    }
 
-        const auto pluginInstance = pluginBox->get().instance.get();
+    juce::AudioProcessorParameter* PluginHost::getParameter (const KeyType& key, const int parameterIndex) const {
+        return getParameter (keyTable.find (key), parameterIndex);
+    }
+
+    juce::AudioProcessorParameter* PluginHost::getParameter (const PluginHandle handle,
+        const int parameterIndex) const {
+        if (handle >= pluginsByHandle.size()) return nullptr;
+
+        const auto pluginInstance = pluginsByHandle[handle]->instance.get();
         if (!pluginInstance) return nullptr;
 
         return pluginInstance->getHostedParameter (parameterIndex);
@@ -494,40 +1216,28 @@ namespace timeoffaudio {
         return {};
     }
 
-    void PluginHost::audioProcessorParameterChanged (juce::AudioProcessor* processor,
-        int parameterIndex,
-        float newValue) {
-        const auto pluginInstance = dynamic_cast<juce::AudioPluginInstance*> (processor);
-        if (!pluginInstance) return;
+    void PluginHost::beginChangeGestureForParameter (const PluginHandle handle, const int parameterIndex) const {
+        if (const auto parameter = getParameter (handle, parameterIndex)) return parameter->beginChangeGesture();
+    }
 
-        withReadonlyAccess ([&] (const PluginMap& pluginMap) {
-            // TODO: this is not very efficient, but it's the simplest way to get the key
-            // figure out how to get the key from the PluginMap without scanning the whole map
-            for (auto [key, pluginBox] : pluginMap) {
-                if (pluginBox.get().instance.get() == pluginInstance) {
-                    {
-                        const juce::ScopedReadLock lock (listenersLock);
-                        listeners.call (&Listener::pluginInstanceParameterChanged, key, parameterIndex, newValue);
-                    }
+    void PluginHost::endChangeGestureForParameter (const PluginHandle handle, const int parameterIndex) const {
+        if (const auto parameter = getParameter (handle, parameterIndex)) return parameter->endChangeGesture();
+    }
 
-                    break;
-                }
-            }
-        });
+    void PluginHost::setValueForParameter (const PluginHandle handle,
+        const int parameterIndex,
+        const float value) const {
+        if (const auto parameter = getParameter (handle, parameterIndex)) return parameter->setValue (value);
     }
 
-    void PluginHost::audioProcessorChanged (juce::AudioProcessor*, const juce::AudioProcessor::ChangeDetails& details) {
-        if (!details.latencyChanged) return;
+    juce::String PluginHost::getDisplayValueForParameter (const PluginHandle handle,
+        const int parameterIndex,
+        const float value) const {
+        if (const auto parameter = getParameter (handle, parameterIndex)) return parameter->getText (value, 1024);
 
-        {
-            const juce::ScopedReadLock lock (listenersLock);
-            listeners.call (&Listener::latenciesChanged);
-        }
+        return {};
     }
 
-    void PluginHost::audioProcessorParameterChangeGestureBegin (juce::AudioProcessor*, int) {}
-    void PluginHost::audioProcessorParameterChangeGestureEnd (juce::AudioProcessor*, int) {}
-
     void PluginHost::debugPrintState() const {
         DBG ("=============================== Plugin Host State ===============================");
         withReadonlyAccess ([&] (const PluginMap& pluginMap) {
@@ -1,6 +1,21 @@
 #pragma once
 
+#include "BlockDeadlineMonitor.h"
+#include "ListenerRegistry.h"
+#include "MidiEventArena.h"
+#include "PluginCatalog.h"
+#include "PluginDiscoveryService.h"
+#include "PluginKeyTable.h"
+#include "PluginProcessingAdapter.h"
+#include "PluginProcessingState.h"
+#include "PluginProfiler.h"
 #include "PluginScan.h"
+#include "RealtimePluginGraph.h"
+#include "RealtimeSanitizer.h"
+#include "SandboxedPluginInstance.h"
+#include "SharedPluginCatalog.h"
+#include "TelemetryPipeline.h"
+#include "TraceRecorder.h"
 #include "PluginWindow.h"
 #include <choc/containers/choc_Value.h>
 #include <imagiro_util/imagiro_util.h>
@@ -9,35 +24,92 @@
 #include <immer/map.hpp>
 #include <immer/map_transient.hpp>
 #include <immer/set.hpp>
+#include <immer/vector.hpp>
 #include <juce_audio_processors/juce_audio_processors.h>
 
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
 namespace timeoffaudio {
-    class PluginHost : private juce::ChangeListener,
-                       private juce::AudioProcessorListener,
+    class PluginHost : private SharedPluginCatalog::Listener,
                        private juce::Timer,
                        private juce::ComponentListener {
     public:
         using KeyType = std::string;
 
+        // Dense integer handle interned from a KeyType, see getHandle()
+        using PluginHandle                                = PluginKeyTable::Handle;
+        static constexpr PluginHandle invalidPluginHandle = PluginKeyTable::invalidHandle;
+
+        // A realtime block that took longer than the deadline set via setBlockDeadlineFraction
+        struct BlockOverrun {
+            KeyType key; // The plugin that took the longest during the block, empty if it is no longer hosted
+            double pluginMicros   = 0.0;
+            double blockMicros    = 0.0;
+            double deadlineMicros = 0.0;
+            juce::Time time;
+        };
+
+        // A change to the plugin map, as found by diffing the map before and after a withWriteAccess commit
+        struct PluginChange {
+            enum class Type {
+                Loaded,                  // A new instance was added at key
+                Deleted,                 // The instance at key was removed
+                KeyMoved,                // The instance moved from previousKey to key
+                ConnectionsChanged,      // The connections or sidechain connections of the plugin at key changed
+                WindowStateChanged,      // The window of the plugin at key was created, destroyed, opened or closed
+                EnabledParameterRebound, // The plugin at key got a different enabled parameter
+            };
+
+            Type type;
+            KeyType key;
+            KeyType previousKey;                          // Only set for KeyMoved
+            juce::AudioPluginInstance* instance = nullptr; // Already deleted by the time Deleted changes are notified
+            PluginWindow::UpdateType windowUpdate = PluginWindow::UpdateType::None; // For WindowStateChanged
+        };
+        using PluginChangeList = std::vector<PluginChange>;
+
         class Listener {
         public:
             virtual ~Listener() = default;
             virtual void
                 scanProgressed (float /*progress01*/, juce::String /*formatName*/, juce::String /*currentPlugin*/) {}
+            // Called once every format being scanned is done, formatScanFinished is called as each one is
             virtual void scanFinished() {}
+            virtual void formatScanFinished (juce::String /*formatName*/) {}
+            // Called from the scan (or background discovery) thread as soon as plugins are found
+            virtual void pluginsDiscovered (const juce::Array<juce::PluginDescription>& /*pluginDescriptions*/) {}
             virtual void availablePluginsUpdated (const juce::Array<juce::PluginDescription>& /*pluginDescriptions*/) {}
-            virtual void pluginInstanceLoadSuccessful (PluginHost::KeyType /*uuid*/,
+            // Only the plugins that were added, removed or changed since the last call
+            virtual void availablePluginsChanged (const PluginCatalog::Delta& /*delta*/) {}
+            virtual void pluginInstanceLoadSuccessful (const PluginHost::KeyType& /*uuid*/,
                 juce::AudioPluginInstance* /*plugin*/) {}
-            virtual void pluginInstanceDeleted (PluginHost::KeyType /*uuid*/, juce::AudioPluginInstance* /*plugin*/) {}
-            virtual void pluginInstanceParameterChanged (PluginHost::KeyType /*uuid*/,
+            virtual void pluginInstanceDeleted (const PluginHost::KeyType& /*uuid*/,
+                juce::AudioPluginInstance* /*plugin*/) {}
+            // Called on whichever thread the plugin reports the change from, often the audio thread
+            virtual void pluginInstanceParameterChanged (const PluginHost::KeyType& /*uuid*/,
                 int /*parameterIndex*/,
                 float /*newValue*/) {}
             virtual void latenciesChanged() {}
-            virtual void pluginInstanceLoadFailed (PluginHost::KeyType /*uuid*/, std::string /*error*/) {}
-            virtual void pluginWindowUpdated (PluginHost::KeyType, PluginWindow::UpdateType) {}
+            virtual void pluginInstanceLoadFailed (const PluginHost::KeyType& /*uuid*/, std::string /*error*/) {}
+            virtual void pluginWindowUpdated (const PluginHost::KeyType&, PluginWindow::UpdateType) {}
+            virtual void blockDeadlineExceeded (const PluginHost::BlockOverrun& /*overrun*/) {}
+            virtual void pluginInstanceAutoBypassed (const PluginHost::KeyType& /*uuid*/, int /*numOverruns*/) {}
+            // The sandbox process of the plugin at key is gone, the plugin outputs silence from then on
+            virtual void pluginInstanceCrashed (const PluginHost::KeyType& /*uuid*/) {}
+
+            // Called once per withWriteAccess commit that changed anything, with all of its changes: in-place changes,
+            // then loads and moves, then deletes, each in the plugin map's (deterministic) iteration order
+            virtual void pluginsChanged (const PluginHost::PluginChangeList& /*changes*/) {}
 
             // TODO: this is not used anywhere at the moment
-            virtual void pluginInstanceUpdated (PluginHost::KeyType /*uuid*/, juce::AudioPluginInstance* /*plugin*/) {}
+            virtual void pluginInstanceUpdated (const PluginHost::KeyType& /*uuid*/,
+                juce::AudioPluginInstance* /*plugin*/) {}
         };
 
         struct Plugin {
@@ -47,7 +119,18 @@ namespace timeoffaudio {
             std::shared_ptr<PluginWindow> window;
             PluginWindow::UpdateType lastWindowStateUpdate = PluginWindow::UpdateType::None;
             juce::RangedAudioParameter* enabledParameter   = nullptr;
-            ConnectionList connections;
+            ConnectionList connections;          // Plugins this plugin's output feeds the main input of
+            ConnectionList sidechainConnections; // Plugins this plugin's output feeds the sidechain input of
+            PluginHandle handle = invalidPluginHandle; // The handle of the key this plugin is stored at
+
+            // Resolved once when the plugin is created, and moved around along with the instance
+            juce::AudioProcessorParameter* bypassParameter = nullptr;
+            std::shared_ptr<PluginProcessingState> processingState;
+            PluginProcessingAdapter::Options processingOptions; // See setProcessingOptions
+
+            // While hot swapping (see hotSwapPluginInstance), the plugin being crossfaded out. Kept alive until its
+            // crossfade is done, then dropped on the message thread.
+            std::shared_ptr<const Plugin> outgoing;
 
             Plugin() = default;
 
@@ -59,34 +142,71 @@ namespace timeoffaudio {
                 : instance (other.instance),
                   window (other.window),
                   enabledParameter (other.enabledParameter),
-                  connections (other.connections) {}
+                  connections (other.connections),
+                  sidechainConnections (other.sidechainConnections),
+                  handle (other.handle),
+                  bypassParameter (other.bypassParameter),
+                  processingState (other.processingState),
+                  processingOptions (other.processingOptions),
+                  outgoing (other.outgoing) {}
 
             // Move constructor
             Plugin (Plugin&& other) noexcept
                 : instance (std::move (other.instance)),
                   window (std::move (other.window)),
                   enabledParameter (other.enabledParameter),
-                  connections (std::move (other.connections)) {}
+                  connections (std::move (other.connections)),
+                  sidechainConnections (std::move (other.sidechainConnections)),
+                  handle (other.handle),
+                  bypassParameter (other.bypassParameter),
+                  processingState (std::move (other.processingState)),
+                  processingOptions (other.processingOptions),
+                  outgoing (std::move (other.outgoing)) {}
 
             Plugin (std::shared_ptr<juce::AudioPluginInstance> inst,
                 std::shared_ptr<PluginWindow> win,
-                juce::RangedAudioParameter* enabledParameter)
-                : instance (std::move (inst)), window (std::move (win)), enabledParameter (enabledParameter) {}
+                juce::RangedAudioParameter* enabledParameter,
+                PluginHandle handle = invalidPluginHandle)
+                : instance (std::move (inst)),
+                  window (std::move (win)),
+                  enabledParameter (enabledParameter),
+                  handle (handle),
+                  bypassParameter (instance ? instance->getBypassParameter() : nullptr),
+                  processingState (std::make_shared<PluginProcessingState>()) {}
         };
 
-        using PluginMap             = immer::map<KeyType, immer::box<Plugin>>;
-        using TransientPluginMap    = PluginMap::transient_type;
-        using ConnectionsRefreshFn  = std::function<Plugin::ConnectionList (KeyType, const TransientPluginMap&)>;
-        using GetEnabledParameterFn = std::function<juce::RangedAudioParameter*(KeyType)>;
+        using PluginMap          = immer::map<KeyType, immer::box<Plugin>>;
+        using TransientPluginMap = PluginMap::transient_type;
+        using ConnectionsRefreshFn =
+            std::function<Plugin::ConnectionList (const KeyType&, const TransientPluginMap&)>;
+        using GetEnabledParameterFn = std::function<juce::RangedAudioParameter*(const KeyType&)>;
+
+        /*
+            A committed plugin map, along with an index of its plugins by handle and the flat graph compiled from it.
+            Handles with no plugin map to an empty box, i.e. a Plugin without an instance.
+        */
+        struct PluginSnapshot {
+            PluginMap plugins;
+            immer::vector<immer::box<Plugin>> pluginsByHandle;
+            std::shared_ptr<const RealtimePluginGraph> graph;
+
+            // Returns nullptr if there is no plugin at the given handle
+            const Plugin* find (const PluginHandle handle) const /* context: realtime */ {
+                if (handle >= pluginsByHandle.size()) return nullptr;
+                const auto& plugin = pluginsByHandle[handle].get();
+                return plugin.instance ? &plugin : nullptr;
+            }
+        };
 
         explicit PluginHost (
             juce::File pluginListFile,
-            ConnectionsRefreshFn connectionFactory = [] (KeyType, const TransientPluginMap&) -> Plugin::ConnectionList {
-                return {};
-            },
-            GetEnabledParameterFn enabledParameterFactory = [] (KeyType) -> juce::RangedAudioParameter* {
+            ConnectionsRefreshFn connectionFactory =
+                [] (const KeyType&, const TransientPluginMap&) -> Plugin::ConnectionList { return {}; },
+            GetEnabledParameterFn enabledParameterFactory = [] (const KeyType&) -> juce::RangedAudioParameter* {
                 return nullptr;
-            });
+            },
+            ConnectionsRefreshFn sidechainConnectionFactory =
+                [] (const KeyType&, const TransientPluginMap&) -> Plugin::ConnectionList { return {}; });
         ~PluginHost() override;
 
         // Plugin persistence
@@ -96,10 +216,27 @@ namespace timeoffaudio {
         void loadAllPluginsFromState (const choc::value::Value& allPluginsState);
 
         void process (const Plugin& plugin, juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
+        void process (const RealtimePluginGraph& graph,
+            RealtimePluginGraph::Node node,
+            juce::AudioBuffer<float>& buffer,
+            juce::MidiBuffer& midiMessages);
+
+        /*
+            Processes the whole graph, routing audio between plugins through the graph's channel buffers.
+            Plugins with no sources read the given buffer, which then gets replaced by the mix of the plugins that
+            aren't connected to anything. Doesn't allocate: their MIDI only fills the capacity midiMessages already
+            has (see MidiBuffer::ensureSize), and events past it are dropped and counted in getMidiStatus().
+        */
+        void process (const RealtimePluginGraph& graph,
+            juce::AudioBuffer<float>& buffer,
+            juce::MidiBuffer& midiMessages);
         void prepare (int newSampleRate, int newBlockSize, juce::AudioPlayHead* newPlayhead = nullptr);
 
+        // Listeners can be added, removed and notified from any thread, notifications take no lock.
+        // getListenerDispatchStats() returns how often each listener was called and how long its callbacks took.
         void addPluginHostListener (Listener* listener);
         void removePluginHostListener (Listener* listener);
+        choc::value::Value getListenerDispatchStats() const;
 
         // Plugin management
         void createPluginInstance (TransientPluginMap&,
@@ -112,6 +249,24 @@ namespace timeoffaudio {
         void movePluginInstance (KeyType fromKey, KeyType toKey);
         void movePluginInstance (TransientPluginMap&, KeyType fromKey, KeyType toKey);
 
+        /*
+            Replaces the plugin at key without a gap in the audio. The new instance is created, prepared and given its
+            state here, while the current one keeps playing. It's then published with the next snapshot, and the
+            realtime thread crossfades from the current instance to it over crossfadeSamples (at the host's sample
+            rate). The replaced instance is released with the retired plugin maps once the crossfade is done.
+            Its connections, processing options and enabled parameter carry over, and an open window is re-opened
+            for the new instance. hotSwapPluginState loads a state (i.e. a heavy preset) the same way, into a fresh
+            instance of the same plugin.
+        */
+        static constexpr int DEFAULT_HOT_SWAP_CROSSFADE_SAMPLES = 1024;
+        void hotSwapPluginInstance (const KeyType& key,
+            const juce::PluginDescription& pluginDescription,
+            const juce::MemoryBlock& state = juce::MemoryBlock(),
+            int crossfadeSamples           = DEFAULT_HOT_SWAP_CROSSFADE_SAMPLES);
+        void hotSwapPluginState (const KeyType& key,
+            const juce::MemoryBlock& state,
+            int crossfadeSamples = DEFAULT_HOT_SWAP_CROSSFADE_SAMPLES);
+
         /*
             TransientPluginMap is passed by reference to the lambda, so the lambda can mutate the
             TransientPluginMap. This is useful for mutating the TransientPluginMap without the need
@@ -125,10 +280,14 @@ namespace timeoffaudio {
         void withWriteAccess (NonRealtimeMutator&& mutator,
             PostUpdateAction postUpdateAction = PostUpdateAction::None) {
             assertMessageThread();
+            TIMEOFFAUDIO_TRACE_SCOPE ("host", "withWriteAccess");
 
             auto previousNonRealtimeSafePlugins = nonRealtimeSafePlugins;
             auto transientPlugins               = nonRealtimeSafePlugins.transient();
-            std::forward<NonRealtimeMutator> (mutator) (transientPlugins);
+            {
+                TIMEOFFAUDIO_TRACE_SCOPE ("host", "mutate");
+                std::forward<NonRealtimeMutator> (mutator) (transientPlugins);
+            }
 
             // Re-compute the connections after the plugin map is altered each time
             // TODO: Can be optimised via a custom differ:
@@ -143,18 +302,36 @@ namespace timeoffaudio {
             //         [] (const auto& changed) { /* handle changed elements */ }));
 
             if (postUpdateAction == PostUpdateAction::RefreshConnections) {
+                TIMEOFFAUDIO_TRACE_SCOPE ("host", "refreshConnections");
                 for (auto& [key, pluginBox] : transientPlugins) {
                     transientPlugins.set (key, pluginBox.update ([&, key] (auto plugin) {
-                        plugin.connections = getConnectionsFor (key, transientPlugins);
+                        plugin.connections          = getConnectionsFor (key, transientPlugins);
+                        plugin.sidechainConnections = getSidechainConnectionsFor (key, transientPlugins);
                         return plugin;
                     }));
                 }
             }
 
             nonRealtimeSafePlugins = transientPlugins.persistent();
-            diffAndNotifyListeners (previousNonRealtimeSafePlugins, nonRealtimeSafePlugins);
+            {
+                TIMEOFFAUDIO_TRACE_SCOPE ("host", "diff");
+                diffAndNotifyListeners (previousNonRealtimeSafePlugins, nonRealtimeSafePlugins);
+            }
 
-            auto result = synchronizationQueue.enqueue (nonRealtimeSafePlugins);
+            // Compile the flat view the realtime thread walks, the map published along with it keeps it valid
+            std::shared_ptr<const RealtimePluginGraph> graph;
+            {
+                TIMEOFFAUDIO_TRACE_SCOPE ("host", "compileGraph");
+                graph = RealtimePluginGraph::compile (
+                    nonRealtimeSafePlugins,
+                    [this] (const KeyType& key) { return keyTable.find (key); },
+                    blockSize,
+                    graphArena);
+                graphArena = graph->getArena();
+            }
+
+            TIMEOFFAUDIO_TRACE_SCOPE ("host", "enqueue");
+            auto result = synchronizationQueue.enqueue ({ nonRealtimeSafePlugins, pluginsByHandle, std::move (graph) });
             jassert (result);
         }
 
@@ -172,36 +349,139 @@ namespace timeoffaudio {
 
         /*
             Use this to access the plugin graph from the realtime thread.
+            The accessor takes either a const PluginMap&, a const RealtimePluginGraph& to walk the plugins in
+            processing order, or a const PluginSnapshot& to look plugins up by handle.
         */
         template <typename RealtimeAccessor>
         void withRealtimeAccess (RealtimeAccessor&& accessor) {
-            bool isNewCopy = false;
+#if TIMEOFFAUDIO_REALTIME_SANITIZER
+            const RealtimeSanitizer::ScopedRealtimeContext realtimeContext;
+#endif
+            TIMEOFFAUDIO_TRACE_SCOPE ("realtime", "block");
+            blockDeadlineMonitor.beginBlock();
+
             // Get the latest PluginMap submitted for the realtime thread
+            // Every snapshot dequeued here is handed back to the message thread via the deallocationQueue, including
+            // the intermediate ones that get skipped over, as this thread might otherwise be the last one holding them
             while (synchronizationQueue.try_dequeue (realtimeSafePlugins)) {
-                isNewCopy = true;
+                auto result = deallocationQueue.try_enqueue (realtimeSafePlugins);
+                jassert (result);
             }
 
             // Access the realtime-safe copy of the plugin map, which is set to const& to ensure it's read-only
-            std::forward<RealtimeAccessor> (accessor) (static_cast<const PluginMap&> (realtimeSafePlugins));
+            if constexpr (std::is_invocable_v<RealtimeAccessor, const PluginMap&>)
+                std::forward<RealtimeAccessor> (accessor) (static_cast<const PluginMap&> (realtimeSafePlugins.plugins));
+            else if constexpr (std::is_invocable_v<RealtimeAccessor, const RealtimePluginGraph&>)
+                std::forward<RealtimeAccessor> (accessor) (*realtimeSafePlugins.graph);
+            else
+                std::forward<RealtimeAccessor> (accessor) (static_cast<const PluginSnapshot&> (realtimeSafePlugins));
+
+            blockDeadlineMonitor.endBlock();
+        }
 
-            if (isNewCopy) {
-                auto result = deallocationQueue.try_enqueue (realtimeSafePlugins);
-                jassert (result);
+        /*
+            Releases the plugin maps that the realtime thread is done with, on the calling thread.
+            This runs on the host's own timer, so only call it directly when the message loop isn't running,
+            i.e. when driving the host offline.
+        */
+        void releaseRetiredPluginMaps() {
+            // We want to ensure that we keep a copy of the plugin map that is only used to ensure that we don't
+            // deallocate on the RT thread
+            // Why? Without this extra @deallocationCopyPlugins, we run into the risk of realtimeSafePlugins being the
+            // last holding on to certain memory (like when a plugin is deleted)
+            // This will trigger a deallocation on the realtime thread, which is NOT realtime safe.
+
+            // Instead, we keep this extra deallocationCopyPlugins, and run this loop on the message thread to ensure
+            // these deallocations happen away from the realtime thread
+            // We can technically run this on any non-RT thread, as long as it's synchronized with the message thread
+            TIMEOFFAUDIO_TRACE_SCOPE ("host", "releaseRetiredPluginMaps");
+            while (deallocationQueue.try_dequeue (deallocationCopyPlugins)) {
             }
         }
 
+        // Plugin handles
+        // Handles are interned from keys when plugins get created or moved, and stay valid for the host's lifetime.
+        // Resolve them once on the message thread, then use them to look plugins up in a PluginSnapshot or to
+        // address parameters, instead of hashing the key every time.
+        PluginHandle getHandle (const KeyType& key) const;
+        const KeyType& getKey (PluginHandle handle) const;
+
         void traversePluginsFrom (KeyType key, std::function<void (Plugin)> visitor) const;
 
         // Plugin discovery
         juce::Array<juce::AudioPluginFormat*> getFormats() const;
+        void addFormat (std::unique_ptr<juce::AudioPluginFormat> format);
         juce::Array<juce::PluginDescription> getAvailablePlugins() const;
+        // Searches the available plugins by name, manufacturer and category, a page at a time (see PluginCatalog)
+        PluginCatalog::Results searchAvailablePlugins (const PluginCatalog::Query& query) const;
         void clearAllAvailablePlugins();
         void clearAvailablePlugin (const juce::PluginDescription& pluginToClear);
+        // Formats are scanned concurrently, on a thread pool (and so scanner processes and I/O) shared by all
+        // formats. Starting a scan of a format that is already being scanned does nothing.
         void startScan (const juce::String& format);
+        void startScan (const juce::StringArray& formats);
+
+        // Scans go through recently used plugins first, then favourite manufacturers, then the smallest bundles.
+        // Plugins are added to the recently used list as they get loaded, get it back to persist it across sessions.
+        void setScanPriorities (const PluginScanScheduler::Priorities& priorities);
+        PluginScanScheduler::Priorities getScanPriorities() const;
+
+        // Background discovery
+        // Watches the plugin search paths of every format and scans new or modified plugins at idle priority, so
+        // the list stays up to date without explicit scans (see PluginDiscoveryService). It pauses while a scan
+        // started with startScan is in progress. Found plugins are reported via Listener::pluginsDiscovered.
+        void setBackgroundDiscoveryEnabled (bool shouldBeEnabled, const PluginDiscoveryService::Options& options = {});
+        bool isBackgroundDiscoveryEnabled() const;
         bool isScanInProgress() const;
         void abortOngoingScan() const;
         choc::value::Value getScanStatus() const;
 
+        // Plugin processing profiler
+        // When enabled, process() records the time spent in each plugin's processBlock/processBlockBypassed.
+        // getProcessingStats() returns the p50/p99/max block times and DSP load of each plugin since its last call.
+        void setProcessingProfilerEnabled (bool shouldBeEnabled);
+        choc::value::Value getProcessingStats();
+
+        // Block deadline watchdog
+        // Blocks processed within withRealtimeAccess that take longer than the given fraction of the block duration
+        // (as set by prepare) are attributed to their most expensive plugin, and reported via
+        // Listener::blockDeadlineExceeded. When autoBypassAfterOverruns is above 0, plugins that are the worst
+        // offender that many times within OVERRUN_WINDOW_SECONDS get disabled via their enabled parameter.
+        void setBlockDeadlineMonitoringEnabled (bool shouldBeEnabled);
+        void setBlockDeadlineFraction (double fractionOfBlockDuration);
+        void setAutoBypassAfterOverruns (int numOverruns);
+        choc::value::Value getBlockDeadlineStatus() const;
+
+        // MIDI arenas
+        // When processing a whole RealtimePluginGraph, each plugin gets its MIDI through an arena preallocated from
+        // these limits. They apply from the next prepare (or plugin creation). getMidiStatus() returns the number of
+        // events each plugin's arena dropped, and how often a plugin made it grow past its capacity, as well as the
+        // number of output events that didn't fit the host's MIDI buffer.
+        void setMidiLimits (const MidiEventArena::Limits& limits);
+        choc::value::Value getMidiStatus() const;
+
+        // Sandboxing
+        // When enabled, plugins created from then on are loaded in a sandbox process of their own (see
+        // SandboxedPluginInstance), so that a crashing plugin only silences itself and is reported via
+        // Listener::pluginInstanceCrashed. Only supported on macOS and Linux, and without plugin editors.
+        void setSandboxingEnabled (bool shouldBeEnabled);
+        bool isSandboxingEnabled() const;
+
+        // Telemetry
+        // Plugin loads and hot swaps are logged as "plugin_load" and "plugin_hot_swap" events, with how long the
+        // description lookup, instantiation, prepareToPlay, state restore and first processed block took, and the
+        // size of the restored state. Events reach the sinks in batches, on a background thread (see
+        // TelemetryPipeline). They go to juce::Analytics by default, add a FileTelemetrySink to keep a local log.
+        void addTelemetrySink (std::unique_ptr<TelemetrySink> sink);
+
+        // Processing adapters
+        // Runs the plugin at the given key with fixed, larger blocks and/or oversampled (see PluginProcessingAdapter).
+        // The plugin gets re-prepared, so like prepare, only call this while audio isn't being processed. A hot swap
+        // in progress at the key cuts over to the new instance straight away.
+        // getLatencySamples() returns the plugin's latency at the host's sample rate, including its adapter's.
+        void setProcessingOptions (const KeyType& key, const PluginProcessingAdapter::Options& options);
+        int getLatencySamples (const KeyType& key) const;
+
         // Plugin Windows
         void openPluginWindow (KeyType key, timeoffaudio::PluginWindow::Options options = {});
         void openPluginWindow (TransientPluginMap&, KeyType key, timeoffaudio::PluginWindow::Options options = {});
@@ -217,44 +497,163 @@ namespace timeoffaudio {
         void bringPluginWindowToFront (KeyType key);
         void bringPluginWindowToFront (TransientPluginMap&, KeyType key);
 
+        // Applies to every plugin window, open or not, and the ones opened from then on (see
+        // PluginWindow::LifecyclePolicy). By default, editors are deleted after their window was hidden for 30 seconds.
+        void setPluginWindowLifecyclePolicy (const PluginWindow::LifecyclePolicy& policy);
+
         // Plugin parameters
         juce::Array<juce::AudioProcessorParameter*> getParameters (KeyType key) const;
         void beginChangeGestureForParameter (const KeyType& key, int parameterIndex) const;
         void endChangeGestureForParameter (const KeyType& key, int parameterIndex) const;
         void setValueForParameter (const KeyType& key, int parameterIndex, float value) const;
         juce::String getDisplayValueForParameter (const KeyType& key, int parameterIndex, float value) const;
-        void audioProcessorParameterChanged (juce::AudioProcessor* processor,
-            int parameterIndex,
-            float newValue) override;
-        void audioProcessorChanged (juce::AudioProcessor* processor,
-            const juce::AudioProcessor::ChangeDetails& details) override;
-        void audioProcessorParameterChangeGestureBegin (juce::AudioProcessor* processor, int parameterIndex) override;
-        void audioProcessorParameterChangeGestureEnd (juce::AudioProcessor* processor, int parameterIndex) override;
+        void beginChangeGestureForParameter (PluginHandle handle, int parameterIndex) const;
+        void endChangeGestureForParameter (PluginHandle handle, int parameterIndex) const;
+        void setValueForParameter (PluginHandle handle, int parameterIndex, float value) const;
+        juce::String getDisplayValueForParameter (PluginHandle handle, int parameterIndex, float value) const;
 
         void debugPrintState() const;
 
     private:
-        juce::KnownPluginList knownPlugins;
-        std::unique_ptr<timeoffaudio::PluginScan> currentScan { nullptr };
+        // Shared with the other PluginHosts using the same plugin list file, see SharedPluginCatalog
+        std::shared_ptr<SharedPluginCatalog> sharedPluginList;
+        juce::KnownPluginList& knownPlugins;
+        std::unique_ptr<juce::ThreadPool> scanPool; // Shared by the scans of every format, created on first use
+        std::map<juce::String, std::unique_ptr<timeoffaudio::PluginScan>> currentScans; // By format name
+        static constexpr int MAX_SCAN_THREADS = 4;
+        PluginScanScheduler::Priorities scanPriorities;
+        std::unique_ptr<PluginDiscoveryService> discoveryService;
+        static constexpr int MAX_RECENTLY_USED_PLUGINS = 64;
         juce::File pluginListFile;
-        juce::ReadWriteLock listenersLock;
 
-        int sampleRate;
-        int blockSize;
-        juce::AudioPlayHead* playhead;
+        int sampleRate                = 0;
+        int blockSize                 = 0;
+        juce::AudioPlayHead* playhead = nullptr;
+        MidiEventArena::Limits midiLimits;
+        std::atomic<uint64_t> numDroppedOutputMidiEvents { 0 }; // See process (graph, buffer, midiMessages)
+        bool sandboxPlugins       = false;
+        int numHotSwapsInProgress = 0;
+        PluginWindow::LifecyclePolicy windowLifecyclePolicy;
+
+        PluginMap nonRealtimeSafePlugins;
+        PluginSnapshot realtimeSafePlugins, deallocationCopyPlugins;
+        moodycamel::ReaderWriterQueue<PluginSnapshot> synchronizationQueue { 100 };
+        moodycamel::ReaderWriterQueue<PluginSnapshot> deallocationQueue { 100 };
+
+        // Handle lookups for nonRealtimeSafePlugins, kept up to date by updateHandleIndex
+        PluginKeyTable keyTable;
+        immer::vector<immer::box<Plugin>> pluginsByHandle;
+        std::unordered_map<const juce::AudioProcessor*, PluginHandle> handlesByInstance;
 
-        PluginMap realtimeSafePlugins, nonRealtimeSafePlugins, deallocationCopyPlugins;
-        moodycamel::ReaderWriterQueue<PluginMap> synchronizationQueue { 100 };
-        moodycamel::ReaderWriterQueue<PluginMap> deallocationQueue { 100 };
+        /*
+            Listens to one hosted instance. Plugins report parameter changes from the audio thread and their own
+            threads, so the key is published to the listener as a pointer into keyTable (whose keys never move) rather
+            than looked up in handlesByInstance. Removes itself from the instance when destroyed, which waits for
+            callbacks in flight.
+        */
+        class InstanceListener final : private juce::AudioProcessorListener {
+        public:
+            InstanceListener (PluginHost& h, juce::AudioProcessor& i) : host (h), instance (i) {
+                instance.addListener (this);
+            }
+            ~InstanceListener() override { instance.removeListener (this); }
+
+            // Message thread only
+            void setKey (const KeyType& newKey) { key.store (&newKey, std::memory_order_release); }
+
+        private:
+            PluginHost& host;
+            juce::AudioProcessor& instance;
+            std::atomic<const KeyType*> key { nullptr };
+
+            void audioProcessorParameterChanged (juce::AudioProcessor*, int parameterIndex, float newValue) override {
+                if (const auto* currentKey = key.load (std::memory_order_acquire))
+                    host.listeners.call (
+                        &Listener::pluginInstanceParameterChanged, *currentKey, parameterIndex, newValue);
+            }
+
+            void audioProcessorChanged (juce::AudioProcessor*,
+                const juce::AudioProcessor::ChangeDetails& details) override {
+                if (details.latencyChanged) host.listeners.call (&Listener::latenciesChanged);
+            }
+
+            JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (InstanceListener)
+        };
+        // Kept alongside handlesByInstance, by updateHandleIndex
+        std::unordered_map<const juce::AudioProcessor*, std::unique_ptr<InstanceListener>> instanceListeners;
+
+#if TIMEOFFAUDIO_ENABLE_PLUGIN_PROFILER
+        PluginProfiler profiler;
+#endif
+
+        static constexpr int MAX_RECENT_OVERRUNS = 64;
+        BlockDeadlineMonitor blockDeadlineMonitor;
+        std::deque<BlockOverrun> recentOverruns;
+        static constexpr double OVERRUN_WINDOW_SECONDS = 10.0;
+        std::map<KeyType, std::deque<juce::Time>> overrunTimesByKey; // Within the window, oldest first
+        int autoBypassAfterOverruns = 0;
 
         ConnectionsRefreshFn getConnectionsFor;
         GetEnabledParameterFn getEnabledParameterFor;
+        ConnectionsRefreshFn getSidechainConnectionsFor;
 
-        juce::AudioPluginFormatManager formatManager;
-        juce::ListenerList<Listener> listeners;
-        void changeListenerCallback (juce::ChangeBroadcaster* source) override;
+        // Shared by consecutive compiled graphs, see RealtimePluginGraph::SampleArena
+        std::shared_ptr<RealtimePluginGraph::SampleArena> graphArena;
 
-        juce::AudioProcessorParameter* getParameter (KeyType key, int parameterIndex) const;
+        juce::AudioPluginFormatManager formatManager;
+        ListenerRegistry<Listener> listeners;
+        void pluginListChanged (const juce::Array<juce::PluginDescription>& types,
+            const PluginCatalog::Delta& delta) override;
+
+        // Called on the message thread when the sandbox process of a sandboxed plugin is gone
+        void sandboxCrashed (const SandboxedPluginInstance& crashedInstance);
+
+        // Load events waiting for their plugin's first processed block, or for it to go
+        struct PendingLoadEvent {
+            TelemetryEvent event;
+            std::weak_ptr<PluginProcessingState> processingState;
+            juce::int64 loadedTicks = 0;
+        };
+        static constexpr double MAX_FIRST_BLOCK_WAIT_SECONDS = 10.0;
+        TelemetryPipeline telemetry;
+        std::vector<PendingLoadEvent> pendingLoadEvents;
+
+        juce::StringPairArray getLoadTelemetryParameters (const juce::PluginDescription& pluginDescription,
+            const KeyType& key) const;
+        static juce::String getMillisecondsSince (juce::int64 startTicks);
+        void logPluginLoad (TelemetryEvent event, const std::shared_ptr<PluginProcessingState>& processingState);
+        void logLoadsWithFirstBlock();
+
+        // Creates an instance of the plugin, in a sandbox process if sandboxing is enabled
+        std::unique_ptr<juce::AudioPluginInstance> instantiatePlugin (juce::AudioPluginFormat& format,
+            const juce::PluginDescription& pluginDescription,
+            juce::String& errorMessage);
+
+        // Drops the plugins that were hot swapped out, once their crossfade is done
+        void releaseFinishedHotSwaps();
+
+        // Prepares the plugin's instance and processing state for the current sample rate and block size, as adapted
+        // by its processing options
+        void preparePlugin (const Plugin& plugin);
+
+        void processInstance (PluginHandle handle,
+            juce::AudioPluginInstance* instance,
+            juce::AudioProcessorParameter* bypassParameter,
+            PluginProcessingState* processingState,
+            const juce::RangedAudioParameter* enabledParameter,
+            juce::AudioBuffer<float>& buffer,
+            juce::MidiBuffer& midiMessages);
+
+        // processInstance without the measurements, crossfading from the outgoing instance while hot swapping
+        void processHotSwappable (juce::AudioPluginInstance* instance,
+            juce::AudioProcessorParameter* bypassParameter,
+            PluginProcessingState* processingState,
+            const juce::RangedAudioParameter* enabledParameter,
+            juce::AudioBuffer<float>& buffer,
+            juce::MidiBuffer& midiMessages);
+
+        juce::AudioProcessorParameter* getParameter (const KeyType& key, int parameterIndex) const;
+        juce::AudioProcessorParameter* getParameter (PluginHandle handle, int parameterIndex) const;
 
         // Plugin Window Visibility Callback
         // This callback is decoupled from the immer persistence lifecycle, so it likely will be out of sync
@@ -270,26 +669,63 @@ namespace timeoffaudio {
             }
         }
 
+        static void appendInPlaceChanges (const KeyType& key,
+            const Plugin& previousPlugin,
+            const Plugin& newPlugin,
+            PluginChangeList& changes) {
+            if (previousPlugin.connections != newPlugin.connections
+                || previousPlugin.sidechainConnections != newPlugin.sidechainConnections)
+                changes.push_back ({ PluginChange::Type::ConnectionsChanged, key, {}, newPlugin.instance.get() });
+
+            // lastWindowStateUpdate isn't carried over by copies, so only a newly set update counts as a change
+            if (previousPlugin.window != newPlugin.window
+                || (newPlugin.lastWindowStateUpdate != PluginWindow::UpdateType::None
+                    && newPlugin.lastWindowStateUpdate != previousPlugin.lastWindowStateUpdate))
+                changes.push_back ({ PluginChange::Type::WindowStateChanged,
+                    key,
+                    {},
+                    newPlugin.instance.get(),
+                    newPlugin.lastWindowStateUpdate });
+
+            if (previousPlugin.enabledParameter != newPlugin.enabledParameter)
+                changes.push_back ({ PluginChange::Type::EnabledParameterRebound, key, {}, newPlugin.instance.get() });
+        }
+
         void diffAndNotifyListeners (const PluginMap& previousPlugins, const PluginMap& newPlugins) {
+            updateHandleIndex (previousPlugins, newPlugins);
+
+#if TIMEOFFAUDIO_ENABLE_PLUGIN_PROFILER
+            updateProfilerRegistrations (previousPlugins, newPlugins);
+#endif
+
+            // Instances that appeared or disappeared at a key, in diff order, matched up after the diff to tell moves from
+            // loads and deletes
+            std::vector<std::pair<juce::AudioPluginInstance*, KeyType>> previousInstanceKeys, newInstanceKeys;
+            PluginChangeList changes;
+
             immer::diff (previousPlugins,
                 newPlugins,
                 immer::make_differ (
                     [&] (const PluginMap::value_type& added) {
-                        const juce::ScopedReadLock lock (listenersLock);
                         listeners.call (
                             &Listener::pluginInstanceLoadSuccessful, added.first, added.second->instance.get());
+                        newInstanceKeys.emplace_back (added.second->instance.get(), added.first);
                     },
                     [&] (const PluginMap::value_type& removed) {
-                        const juce::ScopedReadLock lock (listenersLock);
                         listeners.call (
                             &Listener::pluginInstanceDeleted, removed.first, removed.second->instance.get());
+                        previousInstanceKeys.emplace_back (removed.second->instance.get(), removed.first);
                     },
                     [&] (const PluginMap::value_type& changedFrom, const PluginMap::value_type& changedTo) {
-                        const juce::ScopedReadLock lock (listenersLock);
-
                         const auto& [changedFromKey, changedFromPluginBox] = changedFrom;
                         const auto& [changedToKey, changedToPluginBox]     = changedTo;
 
+                        if (changedFromKey != changedToKey
+                            || changedFromPluginBox->instance != changedToPluginBox->instance) {
+                            previousInstanceKeys.emplace_back (changedFromPluginBox->instance.get(), changedFromKey);
+                            newInstanceKeys.emplace_back (changedToPluginBox->instance.get(), changedToKey);
+                        }
+
                         if (changedFromKey != changedToKey) {
                             // Notify listeners that the old plugin at the updated key is deleted
                             listeners.call (
@@ -301,22 +737,163 @@ namespace timeoffaudio {
                                 changedTo.second->instance.get());
                         }
 
-                        // If we're here, it means a plugin has been updated in-place, i.e. its connections have been updated, etc
-                        // TODO: add other listener notifications here for in-place plugin updates as needed
+                        // If we're here, it means a plugin has been updated in-place, i.e. its connections have been
+                        // updated, etc. Instances swapped in from another key are reported as moves instead
+                        if (changedFromPluginBox->instance == changedToPluginBox->instance)
+                            appendInPlaceChanges (changedToKey, *changedFromPluginBox, *changedToPluginBox, changes);
                     }));
+
+            const std::unordered_map<juce::AudioPluginInstance*, KeyType> previousKeysByInstance (
+                previousInstanceKeys.begin(), previousInstanceKeys.end());
+            const std::unordered_map<juce::AudioPluginInstance*, KeyType> newKeysByInstance (
+                newInstanceKeys.begin(), newInstanceKeys.end());
+
+            for (const auto& [instance, key] : newInstanceKeys) {
+                if (!instance) continue;
+
+                const auto previousKey = previousKeysByInstance.find (instance);
+                if (previousKey == previousKeysByInstance.end())
+                    changes.push_back ({ PluginChange::Type::Loaded, key, {}, instance });
+                else if (previousKey->second != key)
+                    changes.push_back ({ PluginChange::Type::KeyMoved, key, previousKey->second, instance });
+            }
+
+            for (const auto& [instance, key] : previousInstanceKeys)
+                if (instance && !newKeysByInstance.contains (instance))
+                    changes.push_back ({ PluginChange::Type::Deleted, key, {}, instance });
+
+            if (changes.empty()) return;
+
+            listeners.call (&Listener::pluginsChanged, changes);
         }
 
+        void updateHandleIndex (const PluginMap& previousPlugins, const PluginMap& newPlugins) {
+            const immer::box<Plugin> noPlugin;
+            const auto indexPlugin = [&] (const KeyType& key, const immer::box<Plugin>& pluginBox) {
+                const auto handle = keyTable.intern (key);
+                while (pluginsByHandle.size() <= handle) pluginsByHandle = pluginsByHandle.push_back (noPlugin);
+                pluginsByHandle = pluginsByHandle.set (handle, pluginBox);
+                return handle;
+            };
+
+            const auto rememberInstance = [&] (juce::AudioProcessor* instance, const PluginHandle handle) {
+                handlesByInstance[instance] = handle;
+
+                auto& listener = instanceListeners[instance];
+                if (!listener) listener = std::make_unique<InstanceListener> (*this, *instance);
+                listener->setKey (keyTable.getKey (handle));
+            };
+
+            // Instances move between keys (see movePluginInstance), so only forget an instance's handle if it
+            // still points at the key being replaced
+            const auto forgetInstance = [&] (const juce::AudioProcessor* instance, const PluginHandle handle) {
+                if (const auto entry = handlesByInstance.find (instance);
+                    entry != handlesByInstance.end() && entry->second == handle) {
+                    handlesByInstance.erase (entry);
+                    instanceListeners.erase (instance);
+                }
+            };
+
+            immer::diff (previousPlugins,
+                newPlugins,
+                immer::make_differ (
+                    [&] (const PluginMap::value_type& added) {
+                        rememberInstance (added.second->instance.get(), indexPlugin (added.first, added.second));
+                    },
+                    [&] (const PluginMap::value_type& removed) {
+                        const auto handle = indexPlugin (removed.first, noPlugin);
+                        forgetInstance (removed.second->instance.get(), handle);
+                    },
+                    [&] (const PluginMap::value_type& changedFrom, const PluginMap::value_type& changedTo) {
+                        const auto handle = indexPlugin (changedTo.first, changedTo.second);
+                        if (changedFrom.second->instance != changedTo.second->instance)
+                            forgetInstance (changedFrom.second->instance.get(), handle);
+                        rememberInstance (changedTo.second->instance.get(), handle);
+                    }));
+        }
+
+#if TIMEOFFAUDIO_ENABLE_PLUGIN_PROFILER
+        void updateProfilerRegistrations (const PluginMap& previousPlugins, const PluginMap& newPlugins) {
+            // Instances move between keys (see movePluginInstance), so only release the ones that are truly gone
+            const auto isStillHosted = [&] (const juce::AudioPluginInstance* instance) {
+                return handlesByInstance.find (instance) != handlesByInstance.end();
+            };
+
+            immer::diff (previousPlugins,
+                newPlugins,
+                immer::make_differ (
+                    [&] (const PluginMap::value_type& added) {
+                        profiler.registerInstance (added.second->instance.get());
+                    },
+                    [&] (const PluginMap::value_type& removed) {
+                        if (!isStillHosted (removed.second->instance.get()))
+                            profiler.releaseInstance (removed.second->instance.get());
+                    },
+                    [&] (const PluginMap::value_type& changedFrom, const PluginMap::value_type& changedTo) {
+                        profiler.registerInstance (changedTo.second->instance.get());
+                        if (changedFrom.second->instance != changedTo.second->instance
+                            && !isStillHosted (changedFrom.second->instance.get()))
+                            profiler.releaseInstance (changedFrom.second->instance.get());
+                    }));
+        }
+#endif
+
         void timerCallback() override {
-            // We want to ensure that we keep a copy of the plugin map that is only used to ensure that we don't
-            // deallocate on the RT thread
-            // Why? Without this extra @deallocationCopyPlugins, we run into the risk of realtimeSafePlugins being the
-            // last holding on to certain memory (like when a plugin is deleted)
-            // This will trigger a deallocation on the realtime thread, which is NOT realtime safe.
+            releaseRetiredPluginMaps();
+            handleBlockOverruns();
+            if (numHotSwapsInProgress > 0) releaseFinishedHotSwaps();
+            if (!pendingLoadEvents.empty()) logLoadsWithFirstBlock();
+        }
 
-            // Instead, we keep this extra deallocationCopyPlugins, and run this loop on the message thread to ensure
-            // these deallocations happen away from the realtime thread
-            // We can technically run this on any non-RT thread, as long as it's synchronized with the message thread
-            while (deallocationQueue.try_dequeue (deallocationCopyPlugins)) {
+        static void forgetOldOverruns (std::deque<juce::Time>& overrunTimes, const juce::Time now) {
+            const auto windowStart = now - juce::RelativeTime::seconds (OVERRUN_WINDOW_SECONDS);
+            while (!overrunTimes.empty() && overrunTimes.front() < windowStart) overrunTimes.pop_front();
+        }
+
+        void handleBlockOverruns() {
+            // Counts are over a sliding window, so plugins that stopped overrunning get forgotten again
+            const auto now = juce::Time::getCurrentTime();
+            for (auto entry = overrunTimesByKey.begin(); entry != overrunTimesByKey.end();) {
+                forgetOldOverruns (entry->second, now);
+                entry = entry->second.empty() ? overrunTimesByKey.erase (entry) : std::next (entry);
+            }
+
+            BlockDeadlineMonitor::Overrun overrun;
+            while (blockDeadlineMonitor.popOverrun (overrun)) {
+                BlockOverrun blockOverrun { {},
+                    overrun.worstPluginMicros,
+                    overrun.blockMicros,
+                    overrun.deadlineMicros,
+                    juce::Time::getCurrentTime() };
+
+                // Only blame the plugin if its key still holds the instance that overran
+                juce::RangedAudioParameter* enabledParameter = nullptr;
+                if (overrun.worstHandle < pluginsByHandle.size()) {
+                    const auto& pluginBox = pluginsByHandle[overrun.worstHandle];
+                    if (pluginBox->instance && pluginBox->instance.get() == overrun.worstInstance) {
+                        blockOverrun.key = keyTable.getKey (overrun.worstHandle);
+                        enabledParameter = pluginBox->enabledParameter;
+                    }
+                }
+
+                recentOverruns.push_back (blockOverrun);
+                if ((int) recentOverruns.size() > MAX_RECENT_OVERRUNS) recentOverruns.pop_front();
+
+                listeners.call (&Listener::blockDeadlineExceeded, blockOverrun);
+
+                if (blockOverrun.key.empty()) continue;
+
+                auto& overrunTimes = overrunTimesByKey[blockOverrun.key];
+                overrunTimes.push_back (blockOverrun.time);
+                forgetOldOverruns (overrunTimes, blockOverrun.time);
+
+                const auto numOverruns = (int) overrunTimes.size();
+                if (autoBypassAfterOverruns > 0 && numOverruns >= autoBypassAfterOverruns && enabledParameter) {
+                    enabledParameter->setValueNotifyingHost (0.f);
+                    overrunTimesByKey.erase (blockOverrun.key);
+
+                    listeners.call (&Listener::pluginInstanceAutoBypassed, blockOverrun.key, numOverruns);
+                }
             }
         }
 
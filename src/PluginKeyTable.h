@@ -0,0 +1,66 @@
+#pragma once
+#include <juce_core/juce_core.h>
+
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace timeoffaudio {
+    /*
+        Interns plugin keys (i.e. UUID strings) into dense 32-bit handles, so that hot paths can index plugins by
+        integer instead of hashing and comparing strings.
+
+        Handles are handed out in order, starting at 0, and are never reused: a handle refers to the same key for
+        the lifetime of the table, even after the plugin at that key is deleted.
+
+        Not thread-safe, PluginHost only uses it from the message thread.
+    */
+    class PluginKeyTable {
+    public:
+        using Key    = std::string;
+        using Handle = uint32_t;
+
+        static constexpr Handle invalidHandle = std::numeric_limits<Handle>::max();
+
+        PluginKeyTable() = default;
+
+        // Returns the handle of the given key, allocating one if it's the first time the key is seen
+        Handle intern (const Key& key) {
+            if (const auto handle = find (key); handle != invalidHandle) return handle;
+
+            const auto handle = (Handle) keys.size();
+            jassert (handle != invalidHandle);
+
+            // The deque never moves its elements, so the views into it stay valid
+            handles.emplace (std::string_view (keys.emplace_back (key)), handle);
+            return handle;
+        }
+
+        // Returns the handle of the given key, or invalidHandle if it was never interned
+        Handle find (const Key& key) const {
+            const auto handle = handles.find (std::string_view (key));
+            return handle != handles.end() ? handle->second : invalidHandle;
+        }
+
+        // Returns the key of the given handle, or an empty key for invalidHandle
+        const Key& getKey (const Handle handle) const {
+            static const Key emptyKey;
+            if (handle >= keys.size()) {
+                jassert (handle == invalidHandle);
+                return emptyKey;
+            }
+
+            return keys[handle];
+        }
+
+        size_t size() const { return keys.size(); }
+
+    private:
+        std::deque<Key> keys;
+        std::unordered_map<std::string_view, Handle> handles;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginKeyTable)
+    };
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include "MidiEventArena.h"
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <juce_dsp/juce_dsp.h>
+
+#include <array>
+#include <atomic>
+#include <cmath>
+
+namespace timeoffaudio {
+    /*
+        Adapts the host's blocks to the operating point a plugin runs best at, configured per plugin through
+        Plugin::processingOptions:
+        - Rebuffering: the plugin gets fixed blocks of internalBlockSize samples, collected through a FIFO. This adds
+          internalBlockSize samples of latency.
+        - Oversampling: the plugin runs at 2x or 4x the host's sample rate, through juce::dsp::Oversampling's
+          polyphase IIR half-band filters (which are vectorised). This adds the filters' latency.
+
+        Both can be combined, in which case the rebuffered blocks get oversampled. MIDI timestamps are moved along
+        with the audio. MIDI only ever fills the storage its buffers already have, so events past it are dropped
+        (and counted) rather than allocating.
+    */
+    class PluginProcessingAdapter {
+    public:
+        static constexpr int maxChannels = 32;
+
+        struct Options {
+            int internalBlockSize  = 0; // 0 to process the host's blocks as they come
+            int oversamplingFactor = 1; // 1, 2 or 4
+
+            auto operator<=> (const Options&) const = default;
+
+            bool isActive() const { return internalBlockSize > 0 || getOversamplingFactor() > 1; }
+            int getOversamplingFactor() const { return oversamplingFactor >= 4 ? 4 : oversamplingFactor >= 2 ? 2 : 1; }
+
+            // The sample rate and block size to prepare the plugin instance with
+            double getPluginSampleRate (const double hostSampleRate) const {
+                return hostSampleRate * getOversamplingFactor();
+            }
+            int getPluginBlockSize (const int hostBlockSize) const {
+                return (internalBlockSize > 0 ? internalBlockSize : hostBlockSize) * getOversamplingFactor();
+            }
+        };
+
+        PluginProcessingAdapter() = default;
+
+        // Like prepareToPlay, only call this while the plugin is not being processed
+        void prepare (const int numChannelsToUse, const int hostBlockSize, const Options& newOptions) {
+            options      = newOptions;
+            numChannels  = juce::jlimit (0, maxChannels, numChannelsToUse);
+            fifoSize     = juce::jmax (0, options.internalBlockSize);
+            fifoPosition = 0;
+
+            inputFifo.setSize (numChannels, fifoSize, false, true, false);
+            outputFifo.setSize (numChannels, fifoSize, false, true, false);
+            for (auto* midiBuffer : { &inputMidi, &outputMidi, &pendingOutputMidi, &oversampledMidi }) {
+                midiBuffer->clear();
+                midiBuffer->ensureSize (reservedMidiBytes);
+            }
+
+            oversampling.reset();
+            if (const auto factor = options.getOversamplingFactor(); factor > 1 && numChannels > 0) {
+                oversampling = std::make_unique<juce::dsp::Oversampling<float>> ((size_t) numChannels,
+                    (size_t) (factor == 4 ? 2 : 1),
+                    juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR,
+                    true,
+                    true);
+                oversampling->initProcessing ((size_t) (fifoSize > 0 ? fifoSize : hostBlockSize));
+            }
+
+            latencySamples = fifoSize + (oversampling ? (int) std::ceil (oversampling->getLatencyInSamples()) : 0);
+        }
+
+        bool isActive() const /* context: realtime */ { return fifoSize > 0 || oversampling != nullptr; }
+        const Options& getOptions() const { return options; }
+
+        // The latency added on top of the plugin's own, in samples at the host's sample rate
+        int getLatencySamples() const { return latencySamples; }
+
+        // MIDI events that didn't fit the adapter's buffers, or the one given to process
+        uint64_t getNumDroppedMidiEvents() const { return numDroppedMidiEvents.load (std::memory_order_relaxed); }
+
+        /*
+            Processes a host block, calling processPlugin (buffer, midiMessages) with the plugin's blocks, at the
+            plugin's sample rate. Doesn't allocate.
+        */
+        template <typename ProcessPluginFn>
+        void process (juce::AudioBuffer<float>& buffer,
+            juce::MidiBuffer& midiMessages,
+            ProcessPluginFn&& processPlugin) /* context: realtime */ {
+            if (fifoSize == 0) {
+                processChunk (buffer, midiMessages, processPlugin);
+                return;
+            }
+
+            const auto numSamples        = buffer.getNumSamples();
+            const auto numBufferChannels = juce::jmin (buffer.getNumChannels(), numChannels);
+
+            // Incoming MIDI is collected for the next internal block, and outgoing MIDI played back from the last one
+            pendingOutputMidi.clear();
+            for (int position = 0; position < numSamples;) {
+                const auto numToCopy = juce::jmin (numSamples - position, fifoSize - fifoPosition);
+                for (int channel = 0; channel < numBufferChannels; ++channel) {
+                    inputFifo.copyFrom (channel, fifoPosition, buffer, channel, position, numToCopy);
+                    buffer.copyFrom (channel, position, outputFifo, channel, fifoPosition, numToCopy);
+                }
+                copyMidi (midiMessages, position, numToCopy, fifoPosition - position, inputMidi);
+                copyMidi (outputMidi, fifoPosition, numToCopy, position - fifoPosition, pendingOutputMidi);
+
+                position += numToCopy;
+                fifoPosition += numToCopy;
+                if (fifoPosition < fifoSize) continue;
+
+                // The processed input becomes the next output, moving buffers only swaps their storage
+                processChunk (inputFifo, inputMidi, processPlugin);
+                std::swap (inputFifo, outputFifo);
+                outputMidi.swapWith (inputMidi);
+                inputMidi.clear();
+                fifoPosition = 0;
+            }
+
+            // Copied rather than swapped, so that both buffers keep the storage they were prepared with
+            midiMessages.clear();
+            copyMidi (pendingOutputMidi, 0, numSamples, 0, midiMessages);
+        }
+
+    private:
+        // Enough for a few hundred short events per block, further events get dropped
+        static constexpr size_t reservedMidiBytes = 4096;
+
+        Options options;
+        int numChannels = 0, fifoSize = 0, fifoPosition = 0, latencySamples = 0;
+        std::atomic<uint64_t> numDroppedMidiEvents { 0 };
+
+        juce::AudioBuffer<float> inputFifo, outputFifo;
+        juce::MidiBuffer inputMidi, outputMidi, pendingOutputMidi, oversampledMidi;
+        std::unique_ptr<juce::dsp::Oversampling<float>> oversampling;
+
+        template <typename ProcessPluginFn>
+        void processChunk (juce::AudioBuffer<float>& buffer,
+            juce::MidiBuffer& midiMessages,
+            ProcessPluginFn& processPlugin) /* context: realtime */ {
+            if (!oversampling) {
+                processPlugin (buffer, midiMessages);
+                return;
+            }
+
+            const auto factor = options.getOversamplingFactor();
+            juce::dsp::AudioBlock<float> block (buffer.getArrayOfWritePointers(),
+                (size_t) juce::jmin (buffer.getNumChannels(), numChannels),
+                (size_t) buffer.getNumSamples());
+            auto oversampledBlock = oversampling->processSamplesUp (block);
+
+            std::array<float*, maxChannels> oversampledChannels {};
+            for (size_t channel = 0; channel < oversampledBlock.getNumChannels(); ++channel)
+                oversampledChannels[channel] = oversampledBlock.getChannelPointer (channel);
+            juce::AudioBuffer<float> oversampledBuffer (oversampledChannels.data(),
+                (int) oversampledBlock.getNumChannels(),
+                (int) oversampledBlock.getNumSamples());
+
+            oversampledMidi.clear();
+            for (const auto metadata : midiMessages)
+                addMidiEvent (oversampledMidi, metadata, metadata.samplePosition * factor);
+
+            processPlugin (oversampledBuffer, oversampledMidi);
+            oversampling->processSamplesDown (block);
+
+            midiMessages.clear();
+            for (const auto metadata : oversampledMidi)
+                addMidiEvent (midiMessages, metadata, metadata.samplePosition / factor);
+        }
+
+        // Adds the event if it fits the destination's storage, so that it never allocates
+        void addMidiEvent (juce::MidiBuffer& destination,
+            const juce::MidiMessageMetadata& metadata,
+            const int samplePosition) /* context: realtime */ {
+            if (!MidiEventArena::hasRoomFor (destination, metadata.numBytes, destination.data.getNumAllocated())) {
+                numDroppedMidiEvents.fetch_add (1, std::memory_order_relaxed);
+                return;
+            }
+
+            destination.addEvent (metadata.data, metadata.numBytes, samplePosition);
+        }
+
+        // Like MidiBuffer::addEvents, but through addMidiEvent
+        void copyMidi (const juce::MidiBuffer& source,
+            const int startSample,
+            const int numSamples,
+            const int sampleDeltaToAdd,
+            juce::MidiBuffer& destination) /* context: realtime */ {
+            for (auto event = source.findNextSamplePosition (startSample); event != source.cend(); ++event) {
+                const auto metadata = *event;
+                if (metadata.samplePosition >= startSample + numSamples) break;
+
+                addMidiEvent (destination, metadata, metadata.samplePosition + sampleDeltaToAdd);
+            }
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginProcessingAdapter)
+    };
+}
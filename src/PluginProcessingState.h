@@ -0,0 +1,230 @@
+#pragma once
+#include "MidiEventArena.h"
+#include "PluginProcessingAdapter.h"
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <atomic>
+
+namespace timeoffaudio {
+    /*
+        Realtime state kept per plugin instance: the plugin's MIDI arena, used when processing a whole
+        RealtimePluginGraph, its processing adapter, and for plugins with a bypass parameter, its bypass state.
+
+        The host's enabled parameter is only forwarded to the plugin's bypass parameter when it changes, rather than
+        on every block, as some formats (e.g. VST3) queue a parameter change and notify listeners on every write.
+        Every change is crossfaded between the unprocessed and processed audio, so toggling a plugin doesn't click:
+        - When disabling, the plugin keeps processing while the output fades to the dry signal, and only then gets
+          bypassed.
+        - When enabling, the plugin gets un-bypassed straight away, and the output fades from the dry signal.
+
+        The dry signal isn't delayed by the plugin's latency, so plugins with latency can still comb filter during
+        the crossfade.
+
+        The state of an instance that hot swaps another one (see PluginHost::hotSwapPluginInstance) also crossfades
+        from the outgoing instance's output to its own, see processCrossfade.
+    */
+    class PluginProcessingState {
+    public:
+        static constexpr double crossfadeSeconds = 0.01;
+
+        PluginProcessingState() = default;
+
+        /*
+            Sizes the dry buffer for the given instance and block size, sets the crossfade length, and preallocates
+            the MIDI arena and processing adapter. The sample rate and block size are the host's, the bypass
+            crossfade runs at the plugin's, as set by the adapter options.
+            Like prepareToPlay, only call this while the plugin is not being processed.
+        */
+        void prepare (const juce::AudioPluginInstance& instance,
+            const double sampleRate,
+            const int maxBlockSize,
+            const MidiEventArena::Limits& midiLimits              = {},
+            const PluginProcessingAdapter::Options& adapterOptions = {}) {
+            const auto numChannels =
+                juce::jmax (instance.getTotalNumInputChannels(), instance.getTotalNumOutputChannels());
+            dryBuffer.setSize (numChannels, adapterOptions.getPluginBlockSize (maxBlockSize), false, false, true);
+            wetGain.reset (adapterOptions.getPluginSampleRate (sampleRate), crossfadeSeconds);
+            midiArena.prepare (midiLimits);
+            adapter.prepare (numChannels, maxBlockSize, adapterOptions);
+        }
+
+        // The instance being hot swapped out, along with what it's processed with. Kept alive by the caller until
+        // hasCrossfadeFinished() returns true.
+        struct Crossfade {
+            juce::AudioPluginInstance* instance            = nullptr;
+            juce::AudioProcessorParameter* bypassParameter = nullptr;
+            PluginProcessingState* processingState         = nullptr;
+        };
+
+        /*
+            Sets up a crossfade from the outgoing instance, over the given number of samples, starting from the first
+            block processed with processCrossfade. Call this before the state is handed to the realtime thread.
+        */
+        void prepareCrossfade (const Crossfade& outgoing,
+            const int numChannels,
+            const int maxBlockSize,
+            const int numCrossfadeSamples) {
+            crossfade         = outgoing;
+            crossfadeLength   = juce::jmax (1, numCrossfadeSamples);
+            crossfadePosition = 0;
+            crossfadeBuffer.setSize (numChannels, maxBlockSize, false, false, true);
+            crossfadeMidi.prepare ({});
+            crossfadeFinished.store (outgoing.instance == nullptr, std::memory_order_release);
+        }
+
+        // Drops the outgoing instance straight away, only call this while the plugin is not being processed
+        void cancelCrossfade() { crossfadeFinished.store (true, std::memory_order_release); }
+
+        bool isCrossfading() const /* context: realtime */ {
+            return !crossfadeFinished.load (std::memory_order_acquire);
+        }
+
+        // Once this returns true, the realtime thread is done with the outgoing instance
+        bool hasCrossfadeFinished() const { return crossfadeFinished.load (std::memory_order_acquire); }
+
+        /*
+            Processes a host block with both the outgoing instance, through processOutgoing (crossfade, buffer,
+            midiMessages), and the incoming one, through processIncoming (buffer, midiMessages), and fades from the
+            former's output to the latter's. The outgoing instance's MIDI output is dropped. Doesn't allocate.
+
+            The outgoing instance always gets as many channels as it was prepared with, even when the incoming one has
+            fewer. Channels the incoming buffer doesn't have are silent, and only the shared ones get mixed.
+        */
+        template <typename ProcessIncoming, typename ProcessOutgoing>
+        void processCrossfade (juce::AudioBuffer<float>& buffer,
+            juce::MidiBuffer& midiMessages,
+            ProcessIncoming&& processIncoming,
+            ProcessOutgoing&& processOutgoing) /* context: realtime */ {
+            const auto numSamples          = buffer.getNumSamples();
+            const auto numOutgoingChannels = crossfadeBuffer.getNumChannels();
+            const auto numSharedChannels   = juce::jmin (buffer.getNumChannels(), numOutgoingChannels);
+
+            // The block doesn't fit the outgoing instance's buffer, cut over straight away
+            if (numSamples > crossfadeBuffer.getNumSamples()) {
+                crossfadeFinished.store (true, std::memory_order_release);
+                processIncoming (buffer, midiMessages);
+                return;
+            }
+
+            for (int channel = 0; channel < numOutgoingChannels; ++channel)
+                if (channel < numSharedChannels)
+                    crossfadeBuffer.copyFrom (channel, 0, buffer, channel, 0, numSamples);
+                else
+                    crossfadeBuffer.clear (channel, 0, numSamples);
+            crossfadeMidi.clear();
+            crossfadeMidi.addEvents (midiMessages);
+
+            juce::AudioBuffer<float> outgoingBuffer (
+                crossfadeBuffer.getArrayOfWritePointers(), numOutgoingChannels, numSamples);
+            processOutgoing (crossfade, outgoingBuffer, crossfadeMidi.getBuffer());
+            crossfadeMidi.pluginProcessed();
+            processIncoming (buffer, midiMessages);
+
+            const auto startGain = (float) crossfadePosition / (float) crossfadeLength;
+            crossfadePosition    = juce::jmin (crossfadeLength, crossfadePosition + numSamples);
+            const auto endGain   = (float) crossfadePosition / (float) crossfadeLength;
+
+            for (int channel = 0; channel < numSharedChannels; ++channel) {
+                buffer.applyGainRamp (channel, 0, numSamples, startGain, endGain);
+                buffer.addFromWithRamp (
+                    channel, 0, outgoingBuffer.getReadPointer (channel), numSamples, 1.f - startGain, 1.f - endGain);
+            }
+
+            if (crossfadePosition >= crossfadeLength) crossfadeFinished.store (true, std::memory_order_release);
+        }
+
+        // Load telemetry: when the first block was processed and how long it took, set once by the realtime thread
+        void recordFirstBlock (const juce::int64 startTicks, const juce::int64 elapsedTicks) /* context: realtime */ {
+            if (firstBlockStartTicks.load (std::memory_order_relaxed) != 0) return;
+
+            firstBlockElapsedTicks.store (elapsedTicks, std::memory_order_relaxed);
+            firstBlockStartTicks.store (juce::jmax ((juce::int64) 1, startTicks), std::memory_order_release);
+        }
+
+        // Returns false until the first block was processed
+        bool getFirstBlock (juce::int64& startTicks, juce::int64& elapsedTicks) const {
+            startTicks   = firstBlockStartTicks.load (std::memory_order_acquire);
+            elapsedTicks = firstBlockElapsedTicks.load (std::memory_order_relaxed);
+            return startTicks != 0;
+        }
+
+        PluginProcessingAdapter& getAdapter() /* context: realtime */ { return adapter; }
+        const PluginProcessingAdapter& getAdapter() const { return adapter; }
+
+        MidiEventArena& getMidiArena() /* context: realtime */ { return midiArena; }
+        const MidiEventArena& getMidiArena() const { return midiArena; }
+
+        void process (juce::AudioPluginInstance& instance,
+            juce::AudioProcessorParameter& bypassParameter,
+            const bool isEnabled,
+            juce::AudioBuffer<float>& buffer,
+            juce::MidiBuffer& midiMessages) /* context: realtime */ {
+            if (!hasSentBypass) {
+                // First block, sync the plugin to the enabled state without fading in
+                wetGain.setCurrentAndTargetValue (isEnabled ? 1.f : 0.f);
+                sendBypass (bypassParameter, !isEnabled);
+            }
+
+            if (const auto targetWetGain = isEnabled ? 1.f : 0.f; targetWetGain != wetGain.getTargetValue()) {
+                // Crossfades need the dry signal, so switch straight away if the block doesn't fit the dry buffer
+                if (buffer.getNumSamples() > dryBuffer.getNumSamples())
+                    wetGain.setCurrentAndTargetValue (targetWetGain);
+                else
+                    wetGain.setTargetValue (targetWetGain);
+
+                if (isEnabled) sendBypass (bypassParameter, false);
+            }
+
+            if (!wetGain.isSmoothing()) {
+                if (!isEnabled) sendBypass (bypassParameter, true);
+                instance.processBlock (buffer, midiMessages);
+                return;
+            }
+
+            const auto numSamples  = buffer.getNumSamples();
+            const auto numChannels = juce::jmin (buffer.getNumChannels(), dryBuffer.getNumChannels());
+            for (int channel = 0; channel < numChannels; ++channel)
+                dryBuffer.copyFrom (channel, 0, buffer, channel, 0, numSamples);
+
+            instance.processBlock (buffer, midiMessages);
+
+            const auto startGain = wetGain.getCurrentValue();
+            wetGain.skip (numSamples);
+            const auto endGain = wetGain.getCurrentValue();
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                buffer.applyGainRamp (channel, 0, numSamples, startGain, endGain);
+                buffer.addFromWithRamp (
+                    channel, 0, dryBuffer.getReadPointer (channel), numSamples, 1.f - startGain, 1.f - endGain);
+            }
+
+            // Only bypass the plugin once the output has fully faded to the dry signal
+            if (!isEnabled && !wetGain.isSmoothing()) sendBypass (bypassParameter, true);
+        }
+
+    private:
+        juce::AudioBuffer<float> dryBuffer;
+        MidiEventArena midiArena;
+        PluginProcessingAdapter adapter;
+        juce::SmoothedValue<float, juce::ValueSmoothingTypes::Linear> wetGain { 1.f };
+        bool hasSentBypass = false, sentBypass = false;
+
+        Crossfade crossfade;
+        juce::AudioBuffer<float> crossfadeBuffer;
+        MidiEventArena crossfadeMidi;
+        int crossfadeLength = 1, crossfadePosition = 0;
+        std::atomic<bool> crossfadeFinished { true };
+
+        std::atomic<juce::int64> firstBlockStartTicks { 0 }, firstBlockElapsedTicks { 0 };
+
+        void sendBypass (juce::AudioProcessorParameter& bypassParameter, const bool shouldBeBypassed) {
+            if (hasSentBypass && sentBypass == shouldBeBypassed) return;
+
+            bypassParameter.setValue (shouldBeBypassed ? 1.f : 0.f);
+            hasSentBypass = true;
+            sentBypass    = shouldBeBypassed;
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginProcessingState)
+    };
+}
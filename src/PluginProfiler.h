@@ -0,0 +1,238 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <atomic>
+#include <bit>
+#include <memory>
+
+// Set this to 0 to compile the profiler out entirely, in which case PluginHost::process carries no instrumentation
+#ifndef TIMEOFFAUDIO_ENABLE_PLUGIN_PROFILER
+    #define TIMEOFFAUDIO_ENABLE_PLUGIN_PROFILER 1
+#endif
+
+namespace timeoffaudio {
+    /*
+        Realtime-safe profiler for the time spent inside each hosted plugin's processBlock/processBlockBypassed.
+
+        Durations are recorded into fixed-size, log-scale histograms (4 buckets per octave of nanoseconds), one per
+        plugin instance. Each histogram is split into a few lanes, picked by hashing the calling thread id, so that
+        concurrent audio threads rarely touch the same cache lines. All realtime writes are relaxed atomic increments.
+
+        The slot table is keyed by plugin instance and is only ever mutated from the message thread (via
+        registerInstance/releaseInstance), so the realtime thread never allocates, locks or writes to it.
+    */
+    class PluginProfiler {
+    public:
+        static constexpr int MAX_SLOTS       = 128;
+        static constexpr int MAX_LANES       = 4;
+        static constexpr int SUB_BUCKET_BITS = 2;
+        static constexpr int NUM_OCTAVES     = 36; // Up to ~68 seconds, which is plenty for a single block
+        static constexpr int NUM_BUCKETS     = NUM_OCTAVES << SUB_BUCKET_BITS;
+
+        struct Stats {
+            uint64_t numBlocks    = 0;
+            double p50Micros      = 0.0;
+            double p99Micros      = 0.0;
+            double maxMicros      = 0.0;
+            double dspLoadPercent = 0.0;
+        };
+
+        PluginProfiler()
+            : slots (std::make_unique<Slot[]> (MAX_SLOTS)),
+              previousSnapshots (std::make_unique<Snapshot[]> (MAX_SLOTS)),
+              nanosPerTick (1.0e9 / (double) juce::Time::getHighResolutionTicksPerSecond()) {}
+
+        void setEnabled (bool shouldBeEnabled) noexcept { enabled.store (shouldBeEnabled, std::memory_order_relaxed); }
+        [[nodiscard]] bool isEnabled() const noexcept { return enabled.load (std::memory_order_relaxed); }
+
+        // context: realtime
+        void record (const void* instance, juce::int64 elapsedTicks, int numSamples) noexcept {
+            const auto slot = findSlot (instance);
+            if (slot == nullptr) return;
+
+            const auto nanos = (uint64_t) juce::jmax (0.0, (double) elapsedTicks * nanosPerTick);
+            auto& lane       = slot->lanes[getLaneForCurrentThread()];
+
+            lane.buckets[getBucketIndex (nanos)].fetch_add (1, std::memory_order_relaxed);
+            lane.numBlocks.fetch_add (1, std::memory_order_relaxed);
+            lane.totalNanos.fetch_add (nanos, std::memory_order_relaxed);
+            lane.totalSamples.fetch_add ((uint64_t) numSamples, std::memory_order_relaxed);
+
+            auto previousMax = lane.maxNanos.load (std::memory_order_relaxed);
+            while (nanos > previousMax
+                   && !lane.maxNanos.compare_exchange_weak (previousMax, nanos, std::memory_order_relaxed)) {}
+        }
+
+        // context: message thread
+        void registerInstance (const void* instance) {
+            if (instance == nullptr || findSlot (instance) != nullptr) return;
+
+            for (int probe = 0; probe < MAX_SLOTS; ++probe) {
+                const auto index = getSlotIndex (instance, probe);
+                auto& slot       = slots[index];
+                const auto owner = slot.owner.load (std::memory_order_relaxed);
+
+                if (owner == nullptr || owner == tombstone()) {
+                    slot.reset();
+                    previousSnapshots[index] = {};
+                    // Publish the owner last, so the realtime thread only ever sees a zeroed histogram
+                    slot.owner.store (instance, std::memory_order_release);
+                    return;
+                }
+            }
+
+            // Every slot is in use, this instance simply won't be profiled
+            jassertfalse;
+        }
+
+        // context: message thread
+        void releaseInstance (const void* instance) {
+            if (const auto slot = findSlot (instance)) slot->owner.store (tombstone(), std::memory_order_release);
+        }
+
+        /*
+            Returns the statistics accumulated for the given instance since the previous call to collect() for it.
+            The max is reset by each call, so each call returns the stats of a new measurement window.
+            context: message thread
+        */
+        Stats collect (const void* instance, double sampleRate) {
+            Stats stats;
+
+            const auto slot = findSlot (instance);
+            if (slot == nullptr) return stats;
+
+            auto& previous = previousSnapshots[slot - slots.get()];
+            Snapshot current;
+            uint64_t maxNanos = 0;
+
+            for (auto& lane : slot->lanes) {
+                for (int bucket = 0; bucket < NUM_BUCKETS; ++bucket)
+                    current.buckets[bucket] += lane.buckets[bucket].load (std::memory_order_relaxed);
+
+                current.numBlocks += lane.numBlocks.load (std::memory_order_relaxed);
+                current.totalNanos += lane.totalNanos.load (std::memory_order_relaxed);
+                current.totalSamples += lane.totalSamples.load (std::memory_order_relaxed);
+                maxNanos = juce::jmax (maxNanos, lane.maxNanos.exchange (0, std::memory_order_relaxed));
+            }
+
+            Snapshot window;
+            for (int bucket = 0; bucket < NUM_BUCKETS; ++bucket)
+                window.buckets[bucket] = current.buckets[bucket] - previous.buckets[bucket];
+            window.numBlocks    = current.numBlocks - previous.numBlocks;
+            window.totalNanos   = current.totalNanos - previous.totalNanos;
+            window.totalSamples = current.totalSamples - previous.totalSamples;
+            previous            = current;
+
+            stats.numBlocks = window.numBlocks;
+            if (window.numBlocks == 0) return stats;
+
+            stats.maxMicros = (double) maxNanos / 1000.0;
+            stats.p50Micros = juce::jmin (getPercentileNanos (window, 0.50) / 1000.0, stats.maxMicros);
+            stats.p99Micros = juce::jmin (getPercentileNanos (window, 0.99) / 1000.0, stats.maxMicros);
+
+            if (sampleRate > 0.0 && window.totalSamples > 0) {
+                const auto audioNanos = (double) window.totalSamples / sampleRate * 1.0e9;
+                stats.dspLoadPercent  = 100.0 * (double) window.totalNanos / audioNanos;
+            }
+
+            return stats;
+        }
+
+    private:
+        struct Lane {
+            std::array<std::atomic<uint32_t>, NUM_BUCKETS> buckets {};
+            std::atomic<uint64_t> numBlocks { 0 }, totalNanos { 0 }, totalSamples { 0 }, maxNanos { 0 };
+        };
+
+        struct Slot {
+            std::atomic<const void*> owner { nullptr };
+            Lane lanes[MAX_LANES];
+
+            void reset() noexcept {
+                for (auto& lane : lanes) {
+                    for (auto& bucket : lane.buckets) bucket.store (0, std::memory_order_relaxed);
+                    lane.numBlocks.store (0, std::memory_order_relaxed);
+                    lane.totalNanos.store (0, std::memory_order_relaxed);
+                    lane.totalSamples.store (0, std::memory_order_relaxed);
+                    lane.maxNanos.store (0, std::memory_order_relaxed);
+                }
+            }
+        };
+
+        // Message thread copy of a slot's cumulative counters, used to compute windowed stats
+        struct Snapshot {
+            std::array<uint64_t, NUM_BUCKETS> buckets {};
+            uint64_t numBlocks = 0, totalNanos = 0, totalSamples = 0;
+        };
+
+        std::unique_ptr<Slot[]> slots;
+        std::unique_ptr<Snapshot[]> previousSnapshots;
+        const double nanosPerTick;
+        std::atomic<bool> enabled { false };
+
+        static const void* tombstone() noexcept {
+            static const char marker = 0;
+            return &marker;
+        }
+
+        static int getSlotIndex (const void* instance, int probe) noexcept {
+            const auto hash = (uint64_t) reinterpret_cast<uintptr_t> (instance) * 0x9E3779B97F4A7C15ull;
+            return (int) (((hash >> 32) + (uint64_t) probe) % MAX_SLOTS);
+        }
+
+        Slot* findSlot (const void* instance) const noexcept {
+            if (instance == nullptr) return nullptr;
+
+            for (int probe = 0; probe < MAX_SLOTS; ++probe) {
+                auto& slot       = slots[getSlotIndex (instance, probe)];
+                const auto owner = slot.owner.load (std::memory_order_acquire);
+
+                if (owner == instance) return &slot;
+                if (owner == nullptr) return nullptr;
+            }
+
+            return nullptr;
+        }
+
+        // Hashing the thread id rather than using a thread_local, as TLS in dynamically loaded modules can allocate
+        static int getLaneForCurrentThread() noexcept {
+            const auto threadId = reinterpret_cast<uintptr_t> (juce::Thread::getCurrentThreadId());
+            return (int) (((uint64_t) threadId * 0x9E3779B97F4A7C15ull >> 32) % MAX_LANES);
+        }
+
+        static int getBucketIndex (uint64_t nanos) noexcept {
+            constexpr uint64_t subBuckets = 1ull << SUB_BUCKET_BITS;
+            if (nanos < subBuckets) return (int) nanos;
+
+            const int msb      = (int) std::bit_width (nanos) - 1;
+            const int subIndex = (int) (nanos >> (msb - SUB_BUCKET_BITS)) & (int) (subBuckets - 1);
+            return juce::jmin (((msb - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + subIndex, NUM_BUCKETS - 1);
+        }
+
+        // Returns the midpoint of the bucket's value range
+        static double getBucketValue (int bucket) noexcept {
+            constexpr int subBuckets = 1 << SUB_BUCKET_BITS;
+            if (bucket < subBuckets) return (double) bucket;
+
+            const int octave   = bucket >> SUB_BUCKET_BITS;
+            const int subIndex = bucket & (subBuckets - 1);
+            const auto lower   = std::ldexp ((double) (subBuckets + subIndex), octave - 1);
+            const auto upper   = std::ldexp ((double) (subBuckets + subIndex + 1), octave - 1);
+            return (lower + upper) * 0.5;
+        }
+
+        static double getPercentileNanos (const Snapshot& window, double percentile) noexcept {
+            const auto target = (uint64_t) std::ceil (percentile * (double) window.numBlocks);
+            uint64_t cumulative = 0;
+
+            for (int bucket = 0; bucket < NUM_BUCKETS; ++bucket) {
+                cumulative += window.buckets[bucket];
+                if (cumulative >= target && window.buckets[bucket] > 0) return getBucketValue (bucket);
+            }
+
+            return getBucketValue (NUM_BUCKETS - 1);
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginProfiler)
+    };
+}
@@ -1,96 +1,191 @@
 #pragma once
+#include "PluginScanScheduler.h"
+#include "TraceRecorder.h"
 #include <juce_audio_processors/juce_audio_processors.h>
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 namespace timeoffaudio {
-    class PluginScan final : private juce::Timer {
-        constexpr static int NUM_THREADS = 1;
+    /*
+        Scans the plugin files of one format, on a thread pool that can be shared with the scans of other formats.
+
+        Every job scans a single file per run and then goes to the back of the pool's queue, so scans sharing a pool
+        take turns and several formats get scanned concurrently, within the pool's thread (and so scanner process
+        and I/O) budget. A scan adds as many jobs as the pool has threads, so it can use all of them on its own.
 
+        The pool outlives the scan, so the scan only finishes (and lets onScanFinished destroy it) once all of its jobs
+        are gone, which can take until the file being scanned is done when aborting.
+    */
+    class PluginScan final : private juce::Timer {
     public:
         using ScanProgressCallback =
             std::function<void (float progress01, juce::String formatName, juce::String currentPlugin)>;
         using ScanFinishedCallback = std::function<void()>;
+        // Called from a scan thread as soon as a file yields plugins, with the plugins found in that file
+        using PluginsDiscoveredCallback = std::function<void (const juce::Array<juce::PluginDescription>& plugins)>;
 
         PluginScan (juce::KnownPluginList& l,
             juce::AudioPluginFormat& format,
-            juce::File& failedToLoadPluginsFolder,
+            juce::ThreadPool& sharedPool,
+            const juce::File& failedToLoadPluginsFolder,
             ScanProgressCallback oSP,
             ScanFinishedCallback oSF,
-            bool allowPluginsWhichRequireAsynchronousInstantiation = true,
-            int threads                                            = NUM_THREADS)
+            PluginsDiscoveredCallback oPD,
+            PluginScanScheduler::Priorities priorities             = {},
+            bool allowPluginsWhichRequireAsynchronousInstantiation = true)
             : allowAsync (allowPluginsWhichRequireAsynchronousInstantiation),
-              numThreads (threads),
               list (l),
               formatToScan (format),
-              failedToLoadPluginsFolder (failedToLoadPluginsFolder),
+              pool (sharedPool),
               onScanProgress (std::move(oSP)),
-              onScanFinished (std::move(oSF)) {
-            const auto blacklisted = list.getBlacklistedFiles();
-            directoryScanner = std::make_unique<juce::PluginDirectoryScanner> (list,
-                formatToScan,
-                formatToScan.getDefaultLocationsToSearch(),
-                true,
-                failedToLoadPluginsFolder.getChildFile ("failedToLoadPlugins"),
-                allowAsync);
-            pool = std::make_unique<juce::ThreadPool>(juce::ThreadPoolOptions().withNumberOfThreads(numThreads));
+              onScanFinished (std::move(oSF)),
+              onPluginsDiscovered (std::move (oPD)),
+              // One file per format, as scans of different formats run concurrently
+              deadMansPedalFile (
+                  failedToLoadPluginsFolder.getChildFile ("failedToLoadPlugins-" + format.getName())) {
+            // Plugins that crashed the last scan get blacklisted, like juce::PluginDirectoryScanner does
+            juce::PluginDirectoryScanner::applyBlacklistingsFromDeadMansPedal (list, deadMansPedalFile);
+
+            std::map<juce::String, juce::String> knownManufacturers;
+            for (const auto& type : list.getTypes()) knownManufacturers[type.fileOrIdentifier] = type.manufacturerName;
+
+            scheduler = std::make_unique<PluginScanScheduler> (
+                formatToScan.searchPathsForPlugins (formatToScan.getDefaultLocationsToSearch(), true, allowAsync),
+                std::move (priorities),
+                std::move (knownManufacturers));
             // You need to use at least one thread when scanning plug-ins asynchronously
-            jassert (!allowAsync || (numThreads > 0));
+            jassert (!allowAsync || (pool.getNumThreads() > 0));
 
             start();
         }
 
-        ~PluginScan() override = default;
+        // Only waits for the jobs if the scan is destroyed before it finished, i.e. along with its host
+        ~PluginScan() override {
+            removeOwnJobs (-1);
+            while (numUnfinishedJobs.load() > 0) std::this_thread::yield();
+        }
+
+        // Stops the scan's jobs, the scan finishes right away if none of them is still running, or on the timer once
+        // they're done
+        void abort() {
+            if (isAborting) return;
+            isAborting = true;
 
-        void abort() const { finish(); }
-        [[nodiscard]] float getProgress() const { return directoryScanner->getProgress(); }
+            removeOwnJobs (1000);
+            if (numUnfinishedJobs.load() == 0) finish();
+        }
+        [[nodiscard]] float getProgress() const { return scheduler->getProgress(); }
+        [[nodiscard]] int getNumCandidates() const { return scheduler->getNumCandidates(); }
         [[nodiscard]] juce::String getCurrentPlugin() const
         {
+            const std::lock_guard lock (scanStateMutex);
             return pluginBeingScanned.fromLastOccurrenceOf("\\", false, true);
         }
         [[nodiscard]] juce::String getFormatName() const { return formatToScan.getName(); }
 
     private:
         bool allowAsync = false;
-        const int numThreads;
         juce::KnownPluginList& list;
         juce::AudioPluginFormat& formatToScan;
+        juce::ThreadPool& pool;
         ScanProgressCallback onScanProgress;
         ScanFinishedCallback onScanFinished;
-        std::unique_ptr<juce::PluginDirectoryScanner> directoryScanner;
+        PluginsDiscoveredCallback onPluginsDiscovered;
+        std::unique_ptr<PluginScanScheduler> scheduler;
         juce::String pluginBeingScanned;
-        std::unique_ptr<juce::ThreadPool> pool;
-        juce::File& failedToLoadPluginsFolder;
+
+        // Files being scanned are written to the dead man's pedal file, so they get blacklisted if they crash
+        const juce::File deadMansPedalFile;
+        mutable std::mutex scanStateMutex;
+        juce::StringArray filesBeingScanned, failedFiles;
+
+        // This scan's jobs that haven't been deleted yet, the pool may be running other scans' jobs too
+        std::atomic<int> numUnfinishedJobs { 0 };
+        bool isAborting = false;
 
         void start() {
-            for (int i = numThreads; --i >= 0;) pool->addJob (new ScanJob (*this), true);
+            const auto numJobs = juce::jmax (1, pool.getNumThreads());
+            numUnfinishedJobs  = numJobs;
+            for (int i = numJobs; --i >= 0;) pool.addJob (new ScanJob (*this), true);
 
             startTimerHz (20);
         }
 
-        void finish() const {
+        void removeOwnJobs (const int timeoutMs) {
             // Setting the first argument to true will interrupt the scan jobs that are currently running
             // This is important because it allows the scan to be aborted mid-way through
-            pool->removeAllJobs (true, 1000);
-            jassert (pool->getNumJobs() == 0);
+            // Only this scan's jobs are removed, the other scans sharing the pool keep going
+            OwnJobSelector ownJobs (*this);
+            pool.removeAllJobs (true, timeoutMs, &ownJobs);
+        }
 
-            for (const auto& failed : directoryScanner->getFailedFiles())
+        // Only call this once numUnfinishedJobs is 0, no job may touch the scan after it
+        void finish() {
+            jassert (numUnfinishedJobs.load() == 0);
+
+            for (const auto& failed : failedFiles)
                 list.addToBlacklist(failed);
 
+            // Lets the custom scanner shut its worker process down, as juce::PluginDirectoryScanner's destructor would
+            list.scanFinished();
+
             onScanFinished(); // This should be called last as it will cause the PluginScan to go out of scope and be destroyed
         }
 
         bool scanNextPlugin() {
-            // This check is important because it allows the scan to be aborted mid-way through
-            if (directoryScanner->scanNextFile (true, pluginBeingScanned)) {
-                onScanProgress ((float) getProgress(), formatToScan.getName(), pluginBeingScanned.fromLastOccurrenceOf("\\", false, true));
+            juce::String fileOrIdentifier;
+            if (!scheduler->next (fileOrIdentifier)) return false;
+            TIMEOFFAUDIO_TRACE_SCOPE_WITH_DETAIL ("scan", "scanNextPlugin", fileOrIdentifier);
+            if (list.isListingUpToDate (fileOrIdentifier, formatToScan)
+                || list.getBlacklistedFiles().contains (fileOrIdentifier))
                 return true;
+
+            const auto pluginName = formatToScan.getNameOfPluginFromIdentifier (fileOrIdentifier);
+            {
+                const std::lock_guard lock (scanStateMutex);
+                pluginBeingScanned = pluginName;
+            }
+            onScanProgress (
+                (float) getProgress(), formatToScan.getName(), pluginName.fromLastOccurrenceOf ("\\", false, true));
+
+            setBeingScanned (fileOrIdentifier, true);
+            juce::OwnedArray<juce::PluginDescription> typesFound;
+            list.scanAndAddFile (fileOrIdentifier, true, typesFound, formatToScan);
+            setBeingScanned (fileOrIdentifier, false);
+
+            if (typesFound.isEmpty()) {
+                if (!list.getBlacklistedFiles().contains (fileOrIdentifier)) {
+                    const std::lock_guard lock (scanStateMutex);
+                    failedFiles.add (fileOrIdentifier);
+                }
+            } else if (onPluginsDiscovered) {
+                // Stream the plugins straight away, rather than waiting for the scan to finish
+                juce::Array<juce::PluginDescription> discovered;
+                for (const auto* type : typesFound) discovered.add (*type);
+                onPluginsDiscovered (discovered);
             }
-            return false;
+
+            return true;
+        }
+
+        void setBeingScanned (const juce::String& fileOrIdentifier, const bool isBeingScanned) {
+            const std::lock_guard lock (scanStateMutex);
+            if (isBeingScanned)
+                filesBeingScanned.addIfNotAlreadyThere (fileOrIdentifier);
+            else
+                filesBeingScanned.removeString (fileOrIdentifier);
+
+            if (filesBeingScanned.isEmpty())
+                deadMansPedalFile.deleteFile();
+            else
+                deadMansPedalFile.replaceWithText (filesBeingScanned.joinIntoString ("\n"), true, true, "\n");
         }
 
         void timerCallback() override {
-            if (pool->getNumJobs() == 0) {
+            if (numUnfinishedJobs.load() == 0) {
                 // This function triggers the finish() function to be called
                 // which will destroy the PluginScan object via the onScanFinished callback
                 // Therefore, it must be the very last thing to call in the lifecycle of
@@ -102,8 +197,12 @@ namespace timeoffaudio {
         struct ScanJob final : public juce::ThreadPoolJob {
             explicit ScanJob (PluginScan& s) : ThreadPoolJob ("pluginScanJob"), scan (s) {}
 
+            // Counted down on deletion rather than when finishing, as removed jobs that never ran get deleted too
+            ~ScanJob() override { --scan.numUnfinishedJobs; }
+
+            // Scans one file per run, and then lets the jobs of other scans sharing the pool have a turn
             JobStatus runJob() override {
-                while (!shouldExit() && scan.scanNextPlugin()) {}
+                if (!shouldExit() && scan.scanNextPlugin()) return ThreadPoolJob::JobStatus::jobNeedsRunningAgain;
                 return ThreadPoolJob::JobStatus::jobHasFinished;
             }
 
@@ -111,6 +210,17 @@ namespace timeoffaudio {
             JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ScanJob)
         };
 
+        struct OwnJobSelector final : public juce::ThreadPool::JobSelector {
+            explicit OwnJobSelector (const PluginScan& s) : scan (s) {}
+
+            bool isJobSuitable (juce::ThreadPoolJob* job) override {
+                const auto* scanJob = dynamic_cast<ScanJob*> (job);
+                return scanJob != nullptr && &scanJob->scan == &scan;
+            }
+
+            const PluginScan& scan;
+        };
+
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginScan)
     };
 }
@@ -0,0 +1,17 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+
+namespace timeoffaudio {
+    /*
+        Which scanned plugins PluginHost offers: effects only, and never the host itself (i.e. JucePlugin_Name, passed
+        in as hostName). Shared by CustomPluginScanner and the scanner's batch mode, which is built without knowing the
+        host's name.
+    */
+    inline bool isHostablePlugin (const juce::PluginDescription& plugin, const juce::String& hostName) {
+        if (plugin.isInstrument) return false;
+        if (hostName.isNotEmpty() && plugin.name == hostName) return false;
+        // Add other exclusions here
+
+        return true;
+    }
+}
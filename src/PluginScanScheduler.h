@@ -0,0 +1,132 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace timeoffaudio {
+    /*
+        Decides the order in which a PluginScan goes through the plugin files of a format, so that the plugins users
+        are most likely to want become usable first:
+        1. Recently used plugins, most recent first
+        2. Plugins from favourite manufacturers, matched against the manufacturer already known for the file, or
+           its path (most bundles live in a folder named after their vendor)
+        3. Everything else, smallest bundles first, as they tend to scan fastest
+
+        Ranking looks at the size of every bundle on disk, so it happens on the first scan thread to ask for a
+        candidate rather than on the message thread. next() can be called from several scan threads at once, while
+        getNumCandidates() and getProgress() are read from any thread, so they don't look at the ranked order.
+    */
+    class PluginScanScheduler {
+    public:
+        struct Priorities {
+            juce::StringArray recentlyUsedPlugins;    // fileOrIdentifiers, most recent first
+            juce::StringArray favouriteManufacturers; // Compared case-insensitively
+        };
+
+        PluginScanScheduler (juce::StringArray filesOrIdentifiers,
+            Priorities scanPriorities,
+            std::map<juce::String, juce::String> knownManufacturers = {})
+            : unrankedCandidates (std::move (filesOrIdentifiers)),
+              numCandidates (unrankedCandidates.size()),
+              priorities (std::move (scanPriorities)),
+              manufacturersByFile (std::move (knownManufacturers)) {}
+
+        // Gets the next file to scan, returns false once every candidate was handed out
+        bool next (juce::String& fileOrIdentifier) {
+            // Only read after call_once, which publishes the ranked order to every thread that gets past it
+            std::call_once (ranked, [this] { rankedCandidates = rank(); });
+
+            const auto index = nextIndex.fetch_add (1);
+            if (index >= numCandidates) return false;
+
+            fileOrIdentifier = rankedCandidates[(size_t) index];
+            return true;
+        }
+
+        int getNumCandidates() const { return numCandidates; }
+
+        float getProgress() const {
+            if (numCandidates == 0) return 1.f;
+            return (float) juce::jmin (nextIndex.load(), numCandidates) / (float) numCandidates;
+        }
+
+    private:
+        const juce::StringArray unrankedCandidates;
+        const int numCandidates;
+        const Priorities priorities;
+        const std::map<juce::String, juce::String> manufacturersByFile;
+
+        std::once_flag ranked;
+        std::vector<juce::String> rankedCandidates;
+        std::atomic<int> nextIndex { 0 };
+
+        struct Rank {
+            int recentlyUsedIndex = std::numeric_limits<int>::max();
+            bool isFavourite      = false;
+            juce::int64 size      = std::numeric_limits<juce::int64>::max();
+
+            bool operator< (const Rank& other) const {
+                if (recentlyUsedIndex != other.recentlyUsedIndex) return recentlyUsedIndex < other.recentlyUsedIndex;
+                if (isFavourite != other.isFavourite) return isFavourite;
+                return size < other.size;
+            }
+        };
+
+        std::vector<juce::String> rank() const {
+            std::vector<std::pair<Rank, juce::String>> candidatesByRank;
+            candidatesByRank.reserve ((size_t) numCandidates);
+
+            for (const auto& fileOrIdentifier : unrankedCandidates) {
+                Rank rank;
+                if (const auto index = priorities.recentlyUsedPlugins.indexOf (fileOrIdentifier); index >= 0)
+                    rank.recentlyUsedIndex = index;
+                rank.isFavourite = isFromFavouriteManufacturer (fileOrIdentifier);
+                rank.size        = getBundleSize (fileOrIdentifier);
+                candidatesByRank.emplace_back (rank, fileOrIdentifier);
+            }
+
+            std::stable_sort (candidatesByRank.begin(), candidatesByRank.end(), [] (const auto& a, const auto& b) {
+                return a.first < b.first;
+            });
+
+            std::vector<juce::String> order;
+            order.reserve (candidatesByRank.size());
+            for (const auto& [_, fileOrIdentifier] : candidatesByRank) order.push_back (fileOrIdentifier);
+            return order;
+        }
+
+        bool isFromFavouriteManufacturer (const juce::String& fileOrIdentifier) const {
+            const auto knownManufacturer = manufacturersByFile.find (fileOrIdentifier);
+
+            for (const auto& manufacturer : priorities.favouriteManufacturers) {
+                if (manufacturer.isEmpty()) continue;
+                if (knownManufacturer != manufacturersByFile.end()
+                    && knownManufacturer->second.equalsIgnoreCase (manufacturer))
+                    return true;
+                if (fileOrIdentifier.containsIgnoreCase (manufacturer)) return true;
+            }
+
+            return false;
+        }
+
+        // The size of a plugin file or bundle, unknown (i.e. largest) for identifiers that aren't files
+        static juce::int64 getBundleSize (const juce::String& fileOrIdentifier) {
+            if (!juce::File::isAbsolutePath (fileOrIdentifier)) return std::numeric_limits<juce::int64>::max();
+
+            const juce::File file (fileOrIdentifier);
+            if (!file.isDirectory()) return file.exists() ? file.getSize() : std::numeric_limits<juce::int64>::max();
+
+            juce::int64 size = 0;
+            for (const auto& entry : juce::RangedDirectoryIterator (file, true, "*", juce::File::findFiles))
+                size += entry.getFileSize();
+            return size;
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginScanScheduler)
+    };
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include "GenericPluginEditor.h"
 #include "PluginHost.h"
 #include "PluginWindowLookAndFeel.h"
 #include <juce_audio_processors/juce_audio_processors.h>
@@ -8,7 +9,7 @@
     A desktop window containing a plugin's GUI.
 */
 namespace timeoffaudio {
-    class PluginWindow final : public juce::DocumentWindow {
+    class PluginWindow final : public juce::DocumentWindow, private juce::Timer {
     public:
         enum class Type { normal = 0, generic };
 
@@ -21,6 +22,20 @@ namespace timeoffaudio {
 
         static const Options DEFAULT_OPTIONS;
 
+        /*
+            Keeps the cost of plugin editors the user isn't looking at down, as every open editor holds on to its GPU
+            surfaces and runs its repaint timers on the message thread.
+            - destroyHiddenEditorAfterMs: Once the window has been hidden for that long, its editor is deleted, and
+              re-created at the window's last position and size when it's shown again. 0 keeps hidden editors alive.
+            - unfocusedFrameRateCap: Repaints of the editor are held back to at most this many frames per second
+              while the window isn't focused. This only throttles what JUCE paints (e.g. generic editors), native
+              plugin editors paint themselves. 0 doesn't limit them.
+        */
+        struct LifecyclePolicy {
+            int destroyHiddenEditorAfterMs = 30'000;
+            int unfocusedFrameRateCap      = 0;
+        };
+
         enum class UpdateType { None = 0, Opened, Closed };
 
         explicit PluginWindow (const std::string& key,
@@ -46,10 +61,7 @@ namespace timeoffaudio {
                     juce::Colour::fromString (options.backgroundHexRGB.value()));
             }
 
-            if (auto* ui = createProcessorEditor (pluginInstance, type)) {
-                setContentOwned (ui, true);
-                setResizable (ui->isResizable(), false);
-            }
+            createEditor();
 
             setConstrainer (&constrainer);
             setTopLeftPosition (options.xPos, options.yPos);
@@ -67,6 +79,14 @@ namespace timeoffaudio {
 
         void closeButtonPressed() override { setVisible (false); }
 
+        void setLifecyclePolicy (const LifecyclePolicy& newPolicy) {
+            policy = newPolicy;
+            updateEditorLifecycle();
+        }
+
+        // False once the editor of the hidden window has been deleted, see LifecyclePolicy
+        bool hasEditor() const { return getContentComponent() != nullptr; }
+
         void setWindowTitlePrefix (const std::string& newPrefix) {
             if (newPrefix.empty())
                 setTitle (
@@ -84,6 +104,8 @@ namespace timeoffaudio {
         std::string pluginInstanceKey;
         juce::AudioPluginInstance& pluginInstance;
         const Type type;
+        LifecyclePolicy policy;
+        juce::Rectangle<int> boundsBeforeEditorDeleted;
         timeoffaudio::PluginWindowLookAndFeel pluginWindowLookAndFeel;
         const juce::PluginHostType currentDAW;
 
@@ -113,6 +135,99 @@ namespace timeoffaudio {
 
         DecoratorConstrainer constrainer { *this };
 
+        /*
+            Installed as the editor's cached image to cap its frame rate: repaints of the editor (and its children)
+            are collected rather than passed on to the window, and flushed at most frameRate times per second.
+        */
+        class FrameRateLimiter final : public juce::CachedComponentImage, private juce::Timer {
+        public:
+            FrameRateLimiter (juce::Component& ownerIn, const int frameRateIn)
+                : owner (ownerIn), frameRate (frameRateIn) {}
+
+            void paint (juce::Graphics& g) override { owner.paintEntireComponent (g, false); }
+
+            bool invalidateAll() override { return invalidate (owner.getLocalBounds()); }
+
+            bool invalidate (const juce::Rectangle<int>& area) override {
+                if (isFlushing) return true;
+
+                pendingArea.add (area);
+                if (!isTimerRunning()) startTimerHz (frameRate);
+                return false;
+            }
+
+            void releaseResources() override {}
+
+        private:
+            juce::Component& owner;
+            const int frameRate;
+            juce::RectangleList<int> pendingArea;
+            bool isFlushing = false;
+
+            void timerCallback() override {
+                stopTimer();
+
+                const auto area = std::exchange (pendingArea, {});
+                const juce::ScopedValueSetter<bool> flushing (isFlushing, true);
+                for (const auto& rectangle : area) owner.repaint (rectangle);
+            }
+        };
+
+        void visibilityChanged() override {
+            // Before the window gets painted, so it doesn't show up empty
+            if (isVisible() && !hasEditor()) createEditor();
+            updateEditorLifecycle();
+
+            DocumentWindow::visibilityChanged();
+        }
+
+        void activeWindowStatusChanged() override {
+            DocumentWindow::activeWindowStatusChanged();
+            updateEditorLifecycle();
+        }
+
+        void updateEditorLifecycle() {
+            if (isVisible() || policy.destroyHiddenEditorAfterMs <= 0 || !hasEditor())
+                stopTimer();
+            else if (!isTimerRunning())
+                startTimer (policy.destroyHiddenEditorAfterMs);
+
+            if (auto* editor = getContentComponent()) {
+                const auto shouldLimit = policy.unfocusedFrameRateCap > 0 && isVisible() && !isActiveWindow();
+                const auto isLimited   = dynamic_cast<FrameRateLimiter*> (editor->getCachedComponentImage()) != nullptr;
+
+                if (shouldLimit && editor->getCachedComponentImage() == nullptr)
+                    editor->setCachedComponentImage (new FrameRateLimiter (*editor, policy.unfocusedFrameRateCap));
+                else if (!shouldLimit && isLimited)
+                    editor->setCachedComponentImage (nullptr);
+            }
+        }
+
+        // The window has been hidden for long enough, see LifecyclePolicy
+        void timerCallback() override {
+            stopTimer();
+            if (isVisible()) return;
+
+            boundsBeforeEditorDeleted = getBounds();
+            clearContentComponent();
+        }
+
+        void createEditor() {
+            auto* ui = createProcessorEditor (pluginInstance, type);
+            if (ui == nullptr) return;
+
+            setContentOwned (ui, true);
+            setResizable (ui->isResizable(), false);
+
+            // A re-created editor starts out at its default size, put the window back where the user left it
+            if (!boundsBeforeEditorDeleted.isEmpty()) {
+                if (ui->isResizable())
+                    setBounds (boundsBeforeEditorDeleted);
+                else
+                    setTopLeftPosition (boundsBeforeEditorDeleted.getPosition());
+            }
+        }
+
         float getDesktopScaleFactor() const override { return 1.0f; }
 
         static juce::AudioProcessorEditor* createProcessorEditor (juce::AudioPluginInstance& pluginInstance,
@@ -125,7 +240,7 @@ namespace timeoffaudio {
             }
 
             if (type == PluginWindow::Type::generic) {
-                auto* result = new juce::GenericAudioProcessorEditor (pluginInstance);
+                auto* result = new GenericPluginEditor (pluginInstance);
                 result->setResizeLimits (200, 300, 1'000, 10'000);
                 return result;
             }
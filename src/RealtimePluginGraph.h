@@ -0,0 +1,354 @@
+#pragma once
+#include "PluginKeyTable.h"
+#include "PluginProcessingState.h"
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <deque>
+#include <span>
+#include <vector>
+
+namespace timeoffaudio {
+    /*
+        A flat, read-only view of the plugin graph for the realtime thread, compiled by PluginHost on every commit.
+
+        Nodes are stored as parallel arrays (instance, enabled and bypass parameters, processing state, handle and
+        connections), in topological order: a plugin comes before the plugins in its connections, so walking the
+        nodes from 0 to size() - 1 visits the graph in processing order. Plugins that are part of a cycle come last,
+        in map order.
+
+        Each node also gets its own channel buffers, carved out of a sample arena at compile time and laid out like
+        the plugin's buses (main input, then sidechain input, then any output-only channels):
+        - A plugin's main output feeds the main input of the plugins in its connections, and the sidechain input of
+          the plugins in its sidechainConnections. Multiple sources get summed.
+        - When a plugin is the only source of the next plugin's main input, feeds nothing else and the channel
+          counts match, the next plugin's main input aliases its channels, so chains are processed in place.
+        - Plugins with no main sources read the host's buffer, and plugins connected to nothing are mixed back
+          into it.
+
+        MIDI follows the main connections the same way, through the MIDI arena of each plugin's processing state.
+        A plugin that is the only destination of its single source processes the source's arena in place.
+
+        The graph holds raw pointers only. It is published along with the PluginMap it was compiled from, which keeps
+        the instances alive for as long as the graph can be used.
+    */
+    class RealtimePluginGraph {
+    public:
+        using Handle = PluginKeyTable::Handle;
+        using Node   = uint32_t;
+
+        static constexpr Node invalidNode = std::numeric_limits<Node>::max();
+
+        /*
+            Backing memory for the channel buffers. It is handed from one compiled graph to the next, as only the
+            realtime thread reads or writes it, and it only ever uses one graph at a time.
+        */
+        struct SampleArena {
+            juce::HeapBlock<float> samples;
+            size_t numSamples = 0;
+        };
+
+        struct Routing {
+            uint32_t firstChannel       = 0; // Index of the node's first channel pointer
+            uint32_t numChannels        = 0; // Number of channels in the node's processBlock buffer
+            uint32_t numMainInputs      = 0;
+            uint32_t numSidechainInputs = 0;
+            uint32_t numMainOutputs     = 0;
+
+            uint32_t firstSource         = 0; // Index of the node's first source, main sources come first
+            uint32_t numMainSources      = 0;
+            uint32_t numSidechainSources = 0;
+
+            Node midiNode = 0; // The node whose MIDI arena this node processes, itself unless it aliases its source
+
+            bool aliasesMainInput = false; // The main input channels are the outputs of the single main source
+            bool aliasesMidiInput = false; // The MIDI arena is the one of the single main source
+            bool isOutput         = false; // Connected to nothing, so mixed into the host's buffer
+        };
+
+        RealtimePluginGraph() = default;
+
+        /*
+            Compiles the graph from a PluginMap, with getHandle resolving a key into its interned handle.
+            Connections to keys that aren't in the map are dropped. The arena of the previously compiled graph can
+            be passed in, in which case it is reused if it's large enough.
+        */
+        template <typename PluginMap, typename GetHandleFn>
+        static std::shared_ptr<const RealtimePluginGraph> compile (const PluginMap& plugins,
+            GetHandleFn&& getHandle,
+            const int maxBlockSize,
+            std::shared_ptr<SampleArena> arena = {}) {
+            auto graph          = std::make_shared<RealtimePluginGraph>();
+            graph->maxBlockSize = juce::jmax (0, maxBlockSize);
+
+            // Gather the plugins in map order first, and index them by handle to resolve connections
+            struct PendingNode {
+                Handle handle;
+                const typename PluginMap::mapped_type* pluginBox;
+                std::vector<Node> connections, sidechainConnections;
+                int numIncomingConnections = 0;
+            };
+
+            std::vector<PendingNode> pendingNodes;
+            pendingNodes.reserve (plugins.size());
+            for (const auto& [key, pluginBox] : plugins) {
+                const auto handle = getHandle (key);
+                pendingNodes.push_back ({ handle, &pluginBox, {}, {} });
+                if (handle == PluginKeyTable::invalidHandle) continue;
+
+                if (graph->nodesByHandle.size() <= handle) graph->nodesByHandle.resize (handle + 1, invalidNode);
+                graph->nodesByHandle[handle] = (Node) (pendingNodes.size() - 1);
+            }
+
+            const auto resolveConnections = [&] (const auto& connectedKeys, std::vector<Node>& connectedNodes) {
+                for (const auto& connectedKey : connectedKeys) {
+                    const auto connectedNode = graph->findNode (getHandle (connectedKey));
+                    if (connectedNode == invalidNode) continue;
+
+                    connectedNodes.push_back (connectedNode);
+                    ++pendingNodes[connectedNode].numIncomingConnections;
+                }
+            };
+
+            for (auto& pendingNode : pendingNodes) {
+                resolveConnections ((*pendingNode.pluginBox)->connections, pendingNode.connections);
+                resolveConnections ((*pendingNode.pluginBox)->sidechainConnections, pendingNode.sidechainConnections);
+            }
+
+            // Sort topologically (Kahn's algorithm), then append whatever is left, i.e. the nodes in a cycle
+            std::vector<Node> order;
+            order.reserve (pendingNodes.size());
+            std::deque<Node> ready;
+            for (Node node = 0; node < pendingNodes.size(); ++node)
+                if (pendingNodes[node].numIncomingConnections == 0) ready.push_back (node);
+
+            while (!ready.empty()) {
+                const auto node = ready.front();
+                ready.pop_front();
+                order.push_back (node);
+
+                for (const auto* connectedNodes :
+                    { &pendingNodes[node].connections, &pendingNodes[node].sidechainConnections })
+                    for (const auto connectedNode : *connectedNodes)
+                        if (--pendingNodes[connectedNode].numIncomingConnections == 0) ready.push_back (connectedNode);
+            }
+
+            for (Node node = 0; node < pendingNodes.size(); ++node)
+                if (pendingNodes[node].numIncomingConnections > 0) order.push_back (node);
+
+            // Lay the nodes out in that order, remapping the connections to the final node indices
+            std::vector<Node> finalNodes (pendingNodes.size());
+            for (Node index = 0; index < order.size(); ++index) finalNodes[order[index]] = index;
+            for (auto& node : graph->nodesByHandle)
+                if (node != invalidNode) node = finalNodes[node];
+
+            const auto numNodes = pendingNodes.size();
+            std::vector<std::vector<Node>> mainSources (numNodes), sidechainSources (numNodes);
+
+            graph->reserve (numNodes);
+            for (const auto pendingNodeIndex : order) {
+                const auto& pendingNode = pendingNodes[pendingNodeIndex];
+                const auto& plugin      = pendingNode.pluginBox->get();
+                const auto node         = (Node) graph->instances.size();
+
+                graph->instances.push_back (plugin.instance.get());
+                graph->enabledParameters.push_back (plugin.enabledParameter);
+                graph->bypassParameters.push_back (plugin.bypassParameter);
+                graph->processingStates.push_back (plugin.processingState.get());
+                graph->handles.push_back (pendingNode.handle);
+
+                for (const auto connectedNode : pendingNode.connections) {
+                    graph->connections.push_back (finalNodes[connectedNode]);
+                    mainSources[finalNodes[connectedNode]].push_back (node);
+                }
+                for (const auto connectedNode : pendingNode.sidechainConnections)
+                    sidechainSources[finalNodes[connectedNode]].push_back (node);
+                graph->connectionOffsets.push_back ((uint32_t) graph->connections.size());
+
+                auto routing     = getBusLayout (plugin.instance.get());
+                routing.isOutput = pendingNode.connections.empty() && pendingNode.sidechainConnections.empty();
+                graph->routings.push_back (routing);
+            }
+
+            graph->compileRouting (mainSources, sidechainSources, std::move (arena));
+            return graph;
+        }
+
+        size_t size() const /* context: realtime */ { return instances.size(); }
+        bool isEmpty() const /* context: realtime */ { return instances.empty(); }
+
+        // The largest block the channel buffers can hold, i.e. the block size given to PluginHost::prepare
+        int getMaxBlockSize() const /* context: realtime */ { return maxBlockSize; }
+
+        juce::AudioPluginInstance* getInstance (const Node node) const /* context: realtime */ {
+            return instances[node];
+        }
+
+        juce::RangedAudioParameter* getEnabledParameter (const Node node) const /* context: realtime */ {
+            return enabledParameters[node];
+        }
+
+        // The plugin's own bypass parameter, nullptr if it doesn't have one
+        juce::AudioProcessorParameter* getBypassParameter (const Node node) const /* context: realtime */ {
+            return bypassParameters[node];
+        }
+
+        PluginProcessingState* getProcessingState (const Node node) const /* context: realtime */ {
+            return processingStates[node];
+        }
+
+        Handle getHandle (const Node node) const /* context: realtime */ { return handles[node]; }
+
+        // The nodes this node's main output feeds the main input of
+        std::span<const Node> getConnections (const Node node) const /* context: realtime */ {
+            const auto begin = node == 0 ? 0 : connectionOffsets[node - 1];
+            return { connections.data() + begin, connectionOffsets[node] - begin };
+        }
+
+        const Routing& getRouting (const Node node) const /* context: realtime */ { return routings[node]; }
+
+        // The node's channel buffers, i.e. getRouting (node).numChannels pointers to getMaxBlockSize() samples
+        float* const* getChannels (const Node node) const /* context: realtime */ {
+            return channels.data() + routings[node].firstChannel;
+        }
+
+        // The arena holding the node's MIDI, nullptr for nodes without a processing state
+        MidiEventArena* getMidiArena (const Node node) const /* context: realtime */ {
+            const auto processingState = processingStates[routings[node].midiNode];
+            return processingState ? &processingState->getMidiArena() : nullptr;
+        }
+
+        std::span<const Node> getMainSources (const Node node) const /* context: realtime */ {
+            const auto& routing = routings[node];
+            return { sources.data() + routing.firstSource, routing.numMainSources };
+        }
+
+        std::span<const Node> getSidechainSources (const Node node) const /* context: realtime */ {
+            const auto& routing = routings[node];
+            return { sources.data() + routing.firstSource + routing.numMainSources, routing.numSidechainSources };
+        }
+
+        // Returns invalidNode if there is no plugin with the given handle
+        Node findNode (const Handle handle) const /* context: realtime */ {
+            return handle < nodesByHandle.size() ? nodesByHandle[handle] : invalidNode;
+        }
+
+        std::shared_ptr<SampleArena> getArena() const { return arena; }
+
+    private:
+        std::vector<juce::AudioPluginInstance*> instances;
+        std::vector<juce::RangedAudioParameter*> enabledParameters;
+        std::vector<juce::AudioProcessorParameter*> bypassParameters;
+        std::vector<PluginProcessingState*> processingStates;
+        std::vector<Handle> handles;
+
+        // The connections of node i are connections[connectionOffsets[i - 1], connectionOffsets[i])
+        std::vector<uint32_t> connectionOffsets;
+        std::vector<Node> connections;
+
+        std::vector<Node> nodesByHandle;
+
+        int maxBlockSize = 0;
+        std::vector<Routing> routings;
+        std::vector<float*> channels;
+        std::vector<Node> sources;
+        std::shared_ptr<SampleArena> arena;
+
+        static Routing getBusLayout (const juce::AudioPluginInstance* instance) {
+            Routing routing;
+            if (!instance) return routing;
+
+            const auto getChannelCount = [&] (const bool isInput, const int busIndex) {
+                return instance->getBusCount (isInput) > busIndex
+                           ? (uint32_t) instance->getChannelCountOfBus (isInput, busIndex)
+                           : 0u;
+            };
+
+            routing.numMainInputs      = getChannelCount (true, 0);
+            routing.numSidechainInputs = getChannelCount (true, 1);
+            routing.numMainOutputs     = getChannelCount (false, 0);
+            routing.numChannels =
+                (uint32_t) juce::jmax (instance->getTotalNumInputChannels(), instance->getTotalNumOutputChannels());
+
+            // juce::AudioBuffer only refers to external channels without allocating for up to 32 channels
+            jassert (routing.numChannels <= 32);
+            return routing;
+        }
+
+        void compileRouting (const std::vector<std::vector<Node>>& mainSources,
+            const std::vector<std::vector<Node>>& sidechainSources,
+            std::shared_ptr<SampleArena> arenaToReuse) {
+            std::vector<int> numDestinations (size(), 0), numMainDestinations (size(), 0);
+            for (Node node = 0; node < size(); ++node) {
+                for (const auto source : mainSources[node]) {
+                    ++numDestinations[source];
+                    ++numMainDestinations[source];
+                }
+                for (const auto source : sidechainSources[node]) ++numDestinations[source];
+            }
+
+            size_t numArenaChannels = 0, numChannelsTotal = 0;
+            for (Node node = 0; node < size(); ++node) {
+                auto& routing = routings[node];
+                numChannelsTotal += routing.numChannels;
+
+                routing.firstSource         = (uint32_t) sources.size();
+                routing.numMainSources      = (uint32_t) mainSources[node].size();
+                routing.numSidechainSources = (uint32_t) sidechainSources[node].size();
+                sources.insert (sources.end(), mainSources[node].begin(), mainSources[node].end());
+                sources.insert (sources.end(), sidechainSources[node].begin(), sidechainSources[node].end());
+
+                // Sources in a cycle come after this node, so there is nothing to alias yet
+                routing.midiNode = node;
+                if (mainSources[node].size() == 1) {
+                    const auto source        = mainSources[node].front();
+                    routing.aliasesMainInput = source < node && numDestinations[source] == 1
+                                               && routing.numMainInputs > 0
+                                               && routings[source].numMainOutputs == routing.numMainInputs;
+
+                    routing.aliasesMidiInput = source < node && numMainDestinations[source] == 1
+                                               && processingStates[source] && processingStates[node];
+                    if (routing.aliasesMidiInput) routing.midiNode = routings[source].midiNode;
+                }
+
+                numArenaChannels += routing.numChannels - (routing.aliasesMainInput ? routing.numMainInputs : 0);
+            }
+
+            const auto numArenaSamples = numArenaChannels * (size_t) maxBlockSize;
+            arena                      = std::move (arenaToReuse);
+            if (!arena || arena->numSamples < numArenaSamples) {
+                arena = std::make_shared<SampleArena>();
+                arena->samples.allocate (juce::jmax ((size_t) 1, numArenaSamples), true);
+                arena->numSamples = numArenaSamples;
+            }
+
+            channels.reserve (numChannelsTotal);
+            size_t nextArenaChannel = 0;
+            for (Node node = 0; node < size(); ++node) {
+                auto& routing        = routings[node];
+                routing.firstChannel = (uint32_t) channels.size();
+
+                for (uint32_t channel = 0; channel < routing.numChannels; ++channel) {
+                    if (routing.aliasesMainInput && channel < routing.numMainInputs) {
+                        const auto& sourceRouting = routings[mainSources[node].front()];
+                        const auto sourceChannel  = channels[sourceRouting.firstChannel + channel];
+                        channels.push_back (sourceChannel);
+                    } else {
+                        channels.push_back (arena->samples.get() + nextArenaChannel++ * (size_t) maxBlockSize);
+                    }
+                }
+            }
+        }
+
+        void reserve (const size_t numNodes) {
+            instances.reserve (numNodes);
+            enabledParameters.reserve (numNodes);
+            bypassParameters.reserve (numNodes);
+            processingStates.reserve (numNodes);
+            handles.reserve (numNodes);
+            connectionOffsets.reserve (numNodes);
+            routings.reserve (numNodes);
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RealtimePluginGraph)
+    };
+}
@@ -0,0 +1,257 @@
+#include "RealtimeSanitizer.h"
+
+#if JUCE_LINUX || JUCE_MAC
+    #include <cerrno>
+    #include <dlfcn.h>
+    #include <execinfo.h>
+    #include <pthread.h>
+#endif
+
+namespace timeoffaudio {
+    namespace {
+        struct RecordedViolation {
+            std::atomic<bool> isReady { false };
+            RealtimeSanitizer::ViolationType type = RealtimeSanitizer::ViolationType::allocation;
+            size_t size                           = 0;
+            void* frames[RealtimeSanitizer::MAX_STACK_FRAMES] {};
+            int numFrames = 0;
+        };
+
+        struct ViolationLog {
+            RecordedViolation violations[RealtimeSanitizer::MAX_VIOLATIONS];
+            std::atomic<int> numViolations { 0 };
+            std::atomic<int> numViolationsByType[3] {};
+            std::atomic<size_t> numBytesAllocated { 0 };
+        };
+
+        // Never destroyed, as the hooks can still run during static destruction
+        ViolationLog& getViolationLog() noexcept {
+            static auto* log = new ViolationLog();
+            return *log;
+        }
+
+        int captureStackTrace (void** frames, int maxFrames) noexcept {
+#if JUCE_LINUX || JUCE_MAC
+            return backtrace (frames, maxFrames);
+#else
+            juce::ignoreUnused (frames, maxFrames);
+            return 0;
+#endif
+        }
+
+        // backtrace() lazily loads the unwinder (which allocates) on its first call, so make that happen up front
+        [[maybe_unused]] const bool stackTraceWarmedUp = [] {
+            void* frames[1];
+            return captureStackTrace (frames, 1) >= 0;
+        }();
+    }
+
+    void RealtimeSanitizer::reportViolation (const ViolationType type, const size_t size) noexcept {
+        auto& state = getThreadState();
+        if (state.isReporting) return;
+        state.isReporting = true;
+
+        auto& log = getViolationLog();
+        log.numViolationsByType[(int) type].fetch_add (1, std::memory_order_relaxed);
+        if (type == ViolationType::allocation) log.numBytesAllocated.fetch_add (size, std::memory_order_relaxed);
+
+        if (const auto index = log.numViolations.fetch_add (1, std::memory_order_relaxed); index < MAX_VIOLATIONS) {
+            auto& violation     = log.violations[index];
+            violation.type      = type;
+            violation.size      = size;
+            violation.numFrames = captureStackTrace (violation.frames, MAX_STACK_FRAMES);
+            violation.isReady.store (true, std::memory_order_release);
+        }
+
+        state.isReporting = false;
+    }
+
+    int RealtimeSanitizer::getNumViolations() noexcept {
+        return getViolationLog().numViolations.load (std::memory_order_relaxed);
+    }
+
+    int RealtimeSanitizer::getNumViolations (const ViolationType type) noexcept {
+        return getViolationLog().numViolationsByType[(int) type].load (std::memory_order_relaxed);
+    }
+
+    size_t RealtimeSanitizer::getNumBytesAllocated() noexcept {
+        return getViolationLog().numBytesAllocated.load (std::memory_order_relaxed);
+    }
+
+    std::vector<RealtimeSanitizer::Violation> RealtimeSanitizer::getViolations() {
+        jassert (!isRealtimeContext());
+
+        auto& log = getViolationLog();
+        std::vector<Violation> result;
+
+        const auto numRecorded = juce::jmin (getNumViolations(), MAX_VIOLATIONS);
+        for (int index = 0; index < numRecorded; ++index) {
+            const auto& recorded = log.violations[index];
+            if (!recorded.isReady.load (std::memory_order_acquire)) continue;
+
+            std::string stackTrace;
+#if JUCE_LINUX || JUCE_MAC
+            if (const auto symbols = backtrace_symbols (recorded.frames, recorded.numFrames)) {
+                for (int frame = 0; frame < recorded.numFrames; ++frame)
+                    stackTrace += std::string (symbols[frame]) + "\n";
+                std::free (symbols);
+            }
+#endif
+            result.push_back ({ recorded.type, recorded.size, std::move (stackTrace) });
+        }
+
+        return result;
+    }
+
+    void RealtimeSanitizer::clearViolations() noexcept {
+        auto& log = getViolationLog();
+        for (auto& violation : log.violations) violation.isReady.store (false, std::memory_order_relaxed);
+        for (auto& count : log.numViolationsByType) count.store (0, std::memory_order_relaxed);
+        log.numBytesAllocated.store (0, std::memory_order_relaxed);
+        log.numViolations.store (0, std::memory_order_release);
+    }
+}
+
+#if TIMEOFFAUDIO_REALTIME_SANITIZER
+namespace {
+    using timeoffaudio::RealtimeSanitizer;
+
+    void checkAllocation (size_t size) noexcept {
+        if (RealtimeSanitizer::isRealtimeContext())
+            RealtimeSanitizer::reportViolation (RealtimeSanitizer::ViolationType::allocation, size);
+    }
+
+    void checkDeallocation (void* ptr) noexcept {
+        if (ptr != nullptr && RealtimeSanitizer::isRealtimeContext())
+            RealtimeSanitizer::reportViolation (RealtimeSanitizer::ViolationType::deallocation);
+    }
+
+    void* allocateAligned (size_t size, size_t alignment) noexcept {
+        alignment = juce::jmax (alignment, sizeof (void*));
+    #if JUCE_WINDOWS
+        return _aligned_malloc (size == 0 ? 1 : size, alignment);
+    #else
+        void* ptr = nullptr;
+        return posix_memalign (&ptr, alignment, size == 0 ? 1 : size) == 0 ? ptr : nullptr;
+    #endif
+    }
+
+    void freeAligned (void* ptr) noexcept {
+    #if JUCE_WINDOWS
+        _aligned_free (ptr);
+    #else
+        std::free (ptr);
+    #endif
+    }
+}
+
+    #if JUCE_LINUX && defined(__GLIBC__)
+// On glibc, malloc and friends can be replaced outright, forwarding to the libc implementation. operator new
+// below ends up in here too, so these hooks are the only place that needs to check allocations.
+extern "C" {
+void* __libc_malloc (size_t);
+void* __libc_calloc (size_t, size_t);
+void* __libc_realloc (void*, size_t);
+void* __libc_memalign (size_t, size_t);
+void __libc_free (void*);
+
+void* malloc (size_t size) noexcept {
+    checkAllocation (size);
+    return __libc_malloc (size);
+}
+
+void* calloc (size_t count, size_t size) noexcept {
+    checkAllocation (count * size);
+    return __libc_calloc (count, size);
+}
+
+void* realloc (void* ptr, size_t size) noexcept {
+    checkAllocation (size);
+    return __libc_realloc (ptr, size);
+}
+
+void free (void* ptr) noexcept {
+    checkDeallocation (ptr);
+    __libc_free (ptr);
+}
+
+// The aligned variants, which SIMD code tends to use, all forward to memalign
+void* memalign (size_t alignment, size_t size) noexcept {
+    checkAllocation (size);
+    return __libc_memalign (alignment, size);
+}
+
+void* aligned_alloc (size_t alignment, size_t size) noexcept {
+    checkAllocation (size);
+    return __libc_memalign (alignment, size);
+}
+
+int posix_memalign (void** ptr, size_t alignment, size_t size) noexcept {
+    if (alignment % sizeof (void*) != 0 || !juce::isPowerOfTwo (alignment)) return EINVAL;
+
+    checkAllocation (size);
+    *ptr = __libc_memalign (alignment, size);
+    return *ptr != nullptr ? 0 : ENOMEM;
+}
+
+int pthread_mutex_lock (pthread_mutex_t* mutex) noexcept {
+    using LockFn = int (*) (pthread_mutex_t*);
+    static std::atomic<LockFn> realLockFn { nullptr };
+
+    auto realLock = realLockFn.load (std::memory_order_acquire);
+    if (realLock == nullptr) {
+        realLock = (LockFn) dlsym (RTLD_NEXT, "pthread_mutex_lock");
+        realLockFn.store (realLock, std::memory_order_release);
+    }
+
+    if (RealtimeSanitizer::isRealtimeContext())
+        RealtimeSanitizer::reportViolation (RealtimeSanitizer::ViolationType::mutexLock);
+
+    return realLock (mutex);
+}
+}
+
+void* operator new (std::size_t size) {
+    if (auto* ptr = std::malloc (size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete (void* ptr) noexcept { std::free (ptr); }
+
+void operator delete (void* ptr, std::align_val_t) noexcept { std::free (ptr); }
+
+void* operator new (std::size_t size, std::align_val_t alignment) {
+    if (auto* ptr = allocateAligned (size, (size_t) alignment)) return ptr;
+    throw std::bad_alloc();
+}
+    #else
+// Elsewhere, only operator new/delete can be portably replaced
+void* operator new (std::size_t size) {
+    checkAllocation (size);
+    if (auto* ptr = std::malloc (size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete (void* ptr) noexcept {
+    checkDeallocation (ptr);
+    std::free (ptr);
+}
+
+void operator delete (void* ptr, std::align_val_t) noexcept {
+    checkDeallocation (ptr);
+    freeAligned (ptr);
+}
+
+void* operator new (std::size_t size, std::align_val_t alignment) {
+    checkAllocation (size);
+    if (auto* ptr = allocateAligned (size, (size_t) alignment)) return ptr;
+    throw std::bad_alloc();
+}
+    #endif
+
+void operator delete (void* ptr, std::size_t) noexcept { operator delete (ptr); }
+
+void operator delete (void* ptr, std::size_t, std::align_val_t alignment) noexcept {
+    operator delete (ptr, alignment);
+}
+#endif
@@ -0,0 +1,95 @@
+#pragma once
+#include <juce_core/juce_core.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Debug build mode that flags allocations, deallocations and mutex locks made on a thread while it is inside
+// PluginHost::withRealtimeAccess. It replaces the global operator new/delete (and malloc/free, the aligned
+// allocation functions and pthread_mutex_lock on Linux), so it should never be enabled in release builds.
+#ifndef TIMEOFFAUDIO_REALTIME_SANITIZER
+    #define TIMEOFFAUDIO_REALTIME_SANITIZER 0
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+    // initial-exec TLS never allocates on access, which matters when called from within malloc itself
+    #define TIMEOFFAUDIO_SANITIZER_TLS __attribute__ ((tls_model ("initial-exec"))) thread_local
+#else
+    #define TIMEOFFAUDIO_SANITIZER_TLS thread_local
+#endif
+
+namespace timeoffaudio {
+    class RealtimeSanitizer {
+    public:
+        static constexpr int MAX_VIOLATIONS   = 64;
+        static constexpr int MAX_STACK_FRAMES = 32;
+
+        enum class ViolationType { allocation = 0, deallocation, mutexLock };
+
+        struct Violation {
+            ViolationType type;
+            size_t size; // The requested size for allocations, 0 otherwise
+            std::string stackTrace;
+        };
+
+        // Marks the current thread as realtime for the lifetime of this object
+        class ScopedRealtimeContext {
+        public:
+            ScopedRealtimeContext() noexcept { ++getThreadState().realtimeDepth; }
+            ~ScopedRealtimeContext() noexcept { --getThreadState().realtimeDepth; }
+
+            JUCE_DECLARE_NON_COPYABLE (ScopedRealtimeContext)
+        };
+
+        // Temporarily lifts the checks on the current thread, i.e. for deliberate, known-safe calls
+        class ScopedSuspension {
+        public:
+            ScopedSuspension() noexcept { ++getThreadState().suspensionDepth; }
+            ~ScopedSuspension() noexcept { --getThreadState().suspensionDepth; }
+
+            JUCE_DECLARE_NON_COPYABLE (ScopedSuspension)
+        };
+
+        static bool isRealtimeContext() noexcept {
+            const auto& state = getThreadState();
+            return state.realtimeDepth > 0 && state.suspensionDepth == 0;
+        }
+
+        // Called by the hooks. Records the violation along with a stack trace of the calling thread
+        static void reportViolation (ViolationType type, size_t size = 0) noexcept;
+
+        static int getNumViolations() noexcept;
+        static size_t getNumBytesAllocated() noexcept;
+        static int getNumViolations (ViolationType type) noexcept;
+
+        // Returns the recorded violations with symbolised stack traces. Must not be called from a realtime context
+        static std::vector<Violation> getViolations();
+        static void clearViolations() noexcept;
+
+        static const char* getViolationTypeName (ViolationType type) noexcept {
+            switch (type) {
+                case ViolationType::allocation:
+                    return "allocation";
+                case ViolationType::deallocation:
+                    return "deallocation";
+                case ViolationType::mutexLock:
+                    return "mutex lock";
+                default:
+                    return "unknown";
+            }
+        }
+
+    private:
+        struct ThreadState {
+            int realtimeDepth   = 0;
+            int suspensionDepth = 0;
+            bool isReporting    = false;
+        };
+
+        static ThreadState& getThreadState() noexcept {
+            static TIMEOFFAUDIO_SANITIZER_TLS ThreadState state;
+            return state;
+        }
+    };
+}
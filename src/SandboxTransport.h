@@ -0,0 +1,213 @@
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_core/juce_core.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#if JUCE_LINUX || JUCE_MAC
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#if JUCE_LINUX
+    #include <climits>
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+#endif
+
+namespace timeoffaudio {
+    // Command line ID the scanner executable recognises to run as a plugin sandbox, rather than as a scanner
+    constexpr const char* SANDBOX_PROCESS_UID = "pluginSandbox";
+
+    /*
+        Control messages between a SandboxedPluginInstance and its sandbox process, sent over the
+        ChildProcessCoordinator connection. Every message starts with its command, written with writeString, and
+        every request gets exactly one reply, starting with the same command.
+        - load: description XML, sample rate, block size, shared memory name
+                -> success, error message, latency, tail length, accepts MIDI, produces MIDI, parameters XML
+        - prepare: sample rate, block size -> latency
+        - getState: -> state
+        - setState: state -> number of parameters, each parameter's normalised value after restoring the state
+    */
+    namespace SandboxCommand {
+        constexpr const char* load     = "load";
+        constexpr const char* prepare  = "prepare";
+        constexpr const char* getState = "getState";
+        constexpr const char* setState = "setState";
+    }
+
+    /*
+        The audio path between a SandboxedPluginInstance and the helper process hosting its plugin.
+
+        Both processes map the same SandboxBlock. Each processBlock call is one request/response round trip on it,
+        without locks or system calls beyond the wakeups:
+        1. The host writes the audio, MIDI and parameter values, then bumps requestSequence and wakes the sandbox
+        2. The sandbox's audio thread, waiting on requestSequence, processes them and writes the results back
+        3. The sandbox sets responseSequence to the request's sequence and wakes the host, which was waiting on it
+
+        Waits spin briefly before sleeping, as the round trip usually completes within microseconds. On Linux they
+        sleep on a (process-shared) futex on the sequence word. Elsewhere they fall back to short sleeps.
+    */
+    struct SandboxBlock {
+        static constexpr int maxChannels   = 32;
+        static constexpr int maxBlockSize  = 8192;
+        static constexpr int maxMidiBytes  = 65536;
+        static constexpr int maxParameters = 4096;
+
+        static_assert (std::atomic<uint32_t>::is_always_lock_free && std::atomic<float>::is_always_lock_free,
+            "Atomics in shared memory must be lock-free, and so address-free");
+
+        std::atomic<uint32_t> requestSequence { 0 }, responseSequence { 0 };
+
+        // Written by the host before bumping requestSequence, and by the sandbox before setting responseSequence
+        int32_t numChannels = 0, numSamples = 0, numMidiBytes = 0, midiOverflowed = 0;
+
+        // Written by the host whenever a parameter changes, applied by the sandbox before processing
+        int32_t numParameters = 0;
+        std::atomic<float> parameterValues[maxParameters];
+        std::atomic<float> bypassValue { 0.f };
+
+        float audio[maxChannels][maxBlockSize];
+        uint8_t midi[maxMidiBytes]; // Packed events, see writeMidi
+    };
+
+    class SandboxSharedMemory {
+    public:
+        SandboxSharedMemory() = default;
+        ~SandboxSharedMemory() { close(); }
+
+        // A name that is unique to this process and instance, to create the shared memory with
+        static juce::String createUniqueName() {
+            return "/timeoffaudio-sandbox-" + juce::String (juce::Time::currentTimeMillis()) + "-"
+                   + juce::String::toHexString (juce::Random::getSystemRandom().nextInt64());
+        }
+
+        bool create (const juce::String& memoryName) { return map (memoryName, true); }
+        bool open (const juce::String& memoryName) { return map (memoryName, false); }
+
+        SandboxBlock* get() const { return block; }
+        const juce::String& getName() const { return name; }
+
+        void close() {
+#if JUCE_LINUX || JUCE_MAC
+            if (block != nullptr) munmap (block, sizeof (SandboxBlock));
+            if (isOwner) shm_unlink (name.toRawUTF8());
+#endif
+            block   = nullptr;
+            isOwner = false;
+        }
+
+        // Waits until word differs from expected, or the timeout passes. Returns true if it differs.
+        static bool wait (std::atomic<uint32_t>& word, const uint32_t expected, const double timeoutMs) {
+            // Spinning first saves a sleep and a wakeup, when the other side answers quickly
+            for (int spin = 0; spin < 4000; ++spin)
+                if (word.load (std::memory_order_acquire) != expected) return true;
+
+            const auto deadline = juce::Time::getMillisecondCounterHiRes() + timeoutMs;
+            while (word.load (std::memory_order_acquire) == expected) {
+                const auto remainingMs = deadline - juce::Time::getMillisecondCounterHiRes();
+                if (remainingMs <= 0) return false;
+#if JUCE_LINUX
+                timespec timeout { (time_t) (remainingMs / 1000.0),
+                    (long) (std::fmod (remainingMs, 1000.0) * 1.0e6) };
+                syscall (SYS_futex, reinterpret_cast<uint32_t*> (&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+#else
+                juce::Thread::sleep (0);
+#endif
+            }
+
+            return true;
+        }
+
+        static void wake (std::atomic<uint32_t>& word) {
+#if JUCE_LINUX
+            syscall (SYS_futex, reinterpret_cast<uint32_t*> (&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+            juce::ignoreUnused (word);
+#endif
+        }
+
+        // Packs a MidiBuffer as (int32 sample position, uint16 size, data) events, returns the number of bytes used
+        static int writeMidi (const juce::MidiBuffer& midiMessages, uint8_t* destination, int& overflowed) {
+            int numBytes = 0;
+            overflowed   = 0;
+            for (const auto metadata : midiMessages) {
+                const auto eventSize = (int) (sizeof (int32_t) + sizeof (uint16_t)) + metadata.numBytes;
+                if (numBytes + eventSize > SandboxBlock::maxMidiBytes) {
+                    overflowed = 1;
+                    break;
+                }
+
+                const auto samplePosition = (int32_t) metadata.samplePosition;
+                const auto size           = (uint16_t) metadata.numBytes;
+                std::memcpy (destination + numBytes, &samplePosition, sizeof (samplePosition));
+                std::memcpy (destination + numBytes + sizeof (samplePosition), &size, sizeof (size));
+                std::memcpy (destination + numBytes + sizeof (samplePosition) + sizeof (size),
+                    metadata.data,
+                    (size_t) metadata.numBytes);
+                numBytes += eventSize;
+            }
+
+            return numBytes;
+        }
+
+        static void readMidi (const uint8_t* source, const int numBytes, juce::MidiBuffer& midiMessages) {
+            midiMessages.clear();
+            for (int position = 0; position + (int) (sizeof (int32_t) + sizeof (uint16_t)) <= numBytes;) {
+                int32_t samplePosition;
+                uint16_t size;
+                std::memcpy (&samplePosition, source + position, sizeof (samplePosition));
+                std::memcpy (&size, source + position + sizeof (samplePosition), sizeof (size));
+                position += (int) (sizeof (samplePosition) + sizeof (size));
+                if (position + size > numBytes) break;
+
+                midiMessages.addEvent (source + position, size, samplePosition);
+                position += size;
+            }
+        }
+
+    private:
+        juce::String name;
+        SandboxBlock* block = nullptr;
+        bool isOwner        = false;
+
+        bool map (const juce::String& memoryName, const bool shouldCreate) {
+            close();
+            name = memoryName;
+
+#if JUCE_LINUX || JUCE_MAC
+            const auto fd = shm_open (name.toRawUTF8(), shouldCreate ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR, 0600);
+            if (fd < 0) return false;
+
+            if (shouldCreate && ftruncate (fd, (off_t) sizeof (SandboxBlock)) != 0) {
+                ::close (fd);
+                shm_unlink (name.toRawUTF8());
+                return false;
+            }
+
+            auto* memory = mmap (nullptr, sizeof (SandboxBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close (fd);
+
+            if (memory == MAP_FAILED) {
+                if (shouldCreate) shm_unlink (name.toRawUTF8());
+                return false;
+            }
+
+            // The creator constructs the block, the memory is zeroed by ftruncate
+            block   = shouldCreate ? new (memory) SandboxBlock() : static_cast<SandboxBlock*> (memory);
+            isOwner = shouldCreate;
+            return true;
+#else
+            juce::ignoreUnused (shouldCreate);
+            return false;
+#endif
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SandboxSharedMemory)
+    };
+}
@@ -0,0 +1,415 @@
+#pragma once
+#include "KnownPluginListScanner.h"
+#include "SandboxTransport.h"
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <juce_events/juce_events.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace timeoffaudio {
+    /*
+        An AudioPluginInstance whose plugin runs in a sandbox process (the scanner executable, started with
+        SANDBOX_PROCESS_UID), so that a crashing plugin only takes its sandbox down.
+
+        Control calls (loading, preparing, state) go over the ChildProcessCoordinator connection and wait for the
+        sandbox's reply. processBlock does a round trip over shared memory instead, see SandboxBlock. Parameters are
+        mirrored as hosted parameters, whose values reach the sandbox with the next block.
+
+        If the sandbox doesn't answer a block in time, the block comes out silent, and blocks are skipped until the
+        sandbox catches up. Once the sandbox is gone, blocks come out silent and onCrashed is called on the message
+        thread.
+
+        Not supported: plugin editors (the generic editor is used instead), sidechain inputs, and double precision
+        processing. Needs POSIX shared memory, so it's only available on macOS and Linux.
+    */
+    class SandboxedPluginInstance final : public juce::AudioPluginInstance, private juce::AsyncUpdater {
+    public:
+        using CrashedCallback = std::function<void (SandboxedPluginInstance& instance)>;
+
+        static constexpr bool isSupported() {
+#if JUCE_LINUX || JUCE_MAC
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        // Starts a sandbox, and loads the plugin into it. Returns nullptr and sets errorMessage on failure.
+        static std::unique_ptr<SandboxedPluginInstance> create (const juce::PluginDescription& description,
+            const double sampleRate,
+            const int blockSize,
+            juce::String& errorMessage,
+            CrashedCallback onCrashed = {}) {
+            if (!isSupported()) {
+                errorMessage = "Sandboxed plugins aren't supported on this platform";
+                return nullptr;
+            }
+
+            std::unique_ptr<SandboxedPluginInstance> instance (
+                new SandboxedPluginInstance (description, std::move (onCrashed)));
+            errorMessage = instance->load (sampleRate, blockSize);
+            if (errorMessage.isNotEmpty()) return nullptr;
+
+            return instance;
+        }
+
+        ~SandboxedPluginInstance() override {
+            coordinator.reset(); // Kills the sandbox before its shared memory goes
+            cancelPendingUpdate();
+        }
+
+        bool hasCrashed() const { return crashed.load(); }
+        // Blocks that came out silent because the sandbox didn't answer in time
+        int getNumDroppedBlocks() const { return numDroppedBlocks.load (std::memory_order_relaxed); }
+
+        // juce::AudioPluginInstance
+        void fillInPluginDescription (juce::PluginDescription& result) const override { result = description; }
+        const juce::String getName() const override { return description.name; }
+        bool acceptsMidi() const override { return pluginAcceptsMidi; }
+        bool producesMidi() const override { return pluginProducesMidi; }
+        double getTailLengthSeconds() const override { return tailLengthSeconds; }
+        juce::AudioProcessorParameter* getBypassParameter() const override { return bypassParameter.get(); }
+
+        juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+        bool hasEditor() const override { return false; }
+
+        int getNumPrograms() override { return 1; }
+        int getCurrentProgram() override { return 0; }
+        void setCurrentProgram (int) override {}
+        const juce::String getProgramName (int) override { return {}; }
+        void changeProgramName (int, const juce::String&) override {}
+
+        void prepareToPlay (const double sampleRate, const int maximumExpectedSamplesPerBlock) override {
+            // The stream trims the block to what was written when it goes out of scope
+            juce::MemoryBlock request;
+            {
+                juce::MemoryOutputStream stream (request, false);
+                stream.writeString (SandboxCommand::prepare);
+                stream.writeDouble (sampleRate);
+                stream.writeInt (maximumExpectedSamplesPerBlock);
+            }
+
+            if (const auto reply = sendRequest (request, CONTROL_TIMEOUT_MS))
+                setLatencySamples (juce::MemoryInputStream (*reply, false).readInt());
+
+            updateBlockTimeout (sampleRate, maximumExpectedSamplesPerBlock);
+        }
+
+        void releaseResources() override {}
+
+        void getStateInformation (juce::MemoryBlock& destData) override {
+            juce::MemoryBlock request;
+            juce::MemoryOutputStream (request, false).writeString (SandboxCommand::getState);
+
+            if (const auto reply = sendRequest (request, CONTROL_TIMEOUT_MS)) destData = *reply;
+        }
+
+        void setStateInformation (const void* data, const int sizeInBytes) override {
+            juce::MemoryBlock request;
+            {
+                juce::MemoryOutputStream stream (request, false);
+                stream.writeString (SandboxCommand::setState);
+                stream.write (data, (size_t) sizeInBytes);
+            }
+
+            const auto reply = sendRequest (request, CONTROL_TIMEOUT_MS);
+            if (!reply) return;
+
+            // The restored values, so that the mirrors (and with them the shared values) don't keep the old ones
+            juce::MemoryInputStream stream (*reply, false);
+            const auto& parameters = getParameters();
+            const auto numValues   = juce::jmin (stream.readInt(), parameters.size());
+            for (int index = 0; index < numValues; ++index) {
+                const auto value = stream.readFloat();
+                auto* parameter  = parameters[index];
+                if (parameter->getValue() == value) continue;
+
+                parameter->setValue (value);
+                parameter->sendValueChangedMessageToListeners (value);
+            }
+        }
+
+        void processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override
+            /* context: realtime */ {
+            auto* block            = memory.get();
+            const auto numSamples  = buffer.getNumSamples();
+            const auto numChannels = juce::jmin (buffer.getNumChannels(), SandboxBlock::maxChannels);
+
+            // Still busy with a block that timed out, or gone
+            if (block == nullptr || crashed.load() || numSamples > SandboxBlock::maxBlockSize
+                || block->responseSequence.load (std::memory_order_acquire) != sequence) {
+                dropBlock (buffer, midiMessages);
+                return;
+            }
+
+            block->numChannels = numChannels;
+            block->numSamples  = numSamples;
+            const auto numBytes = sizeof (float) * (size_t) numSamples;
+            for (int channel = 0; channel < numChannels; ++channel)
+                std::memcpy (block->audio[channel], buffer.getReadPointer (channel), numBytes);
+            block->numMidiBytes = SandboxSharedMemory::writeMidi (midiMessages, block->midi, block->midiOverflowed);
+
+            block->requestSequence.store (++sequence, std::memory_order_release);
+            SandboxSharedMemory::wake (block->requestSequence);
+
+            if (!SandboxSharedMemory::wait (block->responseSequence, sequence - 1, blockTimeoutMs)) {
+                dropBlock (buffer, midiMessages);
+                return;
+            }
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                std::memcpy (buffer.getWritePointer (channel), block->audio[channel], numBytes);
+            SandboxSharedMemory::readMidi (block->midi, block->numMidiBytes, midiMessages);
+        }
+
+        using juce::AudioPluginInstance::processBlock;
+
+    private:
+        static constexpr int CONTROL_TIMEOUT_MS = 5000;
+        static constexpr int LOAD_TIMEOUT_MS    = 30000;
+
+        /*
+            Our end of the control connection, replies are handed to whoever is waiting in sendRequest.
+
+            Requests start with an id and their command, which the sandbox echoes at the start of its reply. Only the
+            reply to the request being waited for is kept, so that a late reply to a request that timed out can't be
+            taken for the reply to a later one.
+        */
+        class Coordinator final : public juce::ChildProcessCoordinator {
+        public:
+            explicit Coordinator (SandboxedPluginInstance& o) : owner (o) {}
+            ~Coordinator() override { killWorkerProcess(); }
+
+            // Returns the reply without the id and command, or nothing if it didn't come in time
+            std::optional<juce::MemoryBlock> sendAndWaitForReply (const juce::MemoryBlock& request,
+                const int timeoutMs) {
+                juce::MemoryInputStream requestStream (request, false);
+                const auto command = requestStream.readString();
+
+                juce::MemoryBlock message;
+                {
+                    juce::MemoryOutputStream stream (message, false);
+                    const std::lock_guard lock (mutex);
+                    expectedRequestId = ++lastRequestId;
+                    expectedCommand   = command;
+                    reply.reset();
+
+                    stream.writeInt (expectedRequestId);
+                    stream << request;
+                }
+
+                if (!sendMessageToWorker (message)) return std::nullopt;
+
+                std::unique_lock lock (mutex);
+                condvar.wait_for (lock, std::chrono::milliseconds (timeoutMs), [this] {
+                    return reply.has_value() || connectionLost;
+                });
+
+                expectedRequestId = 0; // Anything still to come is stale
+                return std::exchange (reply, std::nullopt);
+            }
+
+        private:
+            void handleMessageFromWorker (const juce::MemoryBlock& message) override {
+                juce::MemoryInputStream stream (message, false);
+                const auto requestId = stream.readInt();
+                const auto command   = stream.readString();
+
+                const std::lock_guard lock (mutex);
+                if (requestId != expectedRequestId || requestId == 0 || command != expectedCommand) return;
+
+                juce::MemoryBlock payload;
+                stream.readIntoMemoryBlock (payload);
+                reply = std::move (payload);
+                condvar.notify_one();
+            }
+
+            void handleConnectionLost() override {
+                {
+                    const std::lock_guard lock (mutex);
+                    connectionLost = true;
+                    condvar.notify_one();
+                }
+
+                owner.sandboxLost();
+            }
+
+            SandboxedPluginInstance& owner;
+            std::mutex mutex;
+            std::condition_variable condvar;
+            std::optional<juce::MemoryBlock> reply;
+            int lastRequestId = 0, expectedRequestId = 0;
+            juce::String expectedCommand;
+            bool connectionLost = false;
+
+            JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Coordinator)
+        };
+
+        // Mirrors a parameter of the sandboxed plugin, writing its value to the shared memory
+        class SandboxedParameter final : public juce::HostedAudioProcessorParameter {
+        public:
+            SandboxedParameter (const juce::XmlElement& xml, std::atomic<float>& shared)
+                : id (xml.getStringAttribute ("id")),
+                  name (xml.getStringAttribute ("name")),
+                  label (xml.getStringAttribute ("label")),
+                  defaultValue ((float) xml.getDoubleAttribute ("default")),
+                  numSteps (xml.getIntAttribute ("numSteps", juce::AudioProcessor::getDefaultNumParameterSteps())),
+                  discrete (xml.getBoolAttribute ("discrete")),
+                  boolean (xml.getBoolAttribute ("boolean")),
+                  sharedValue (shared) {
+                setValue ((float) xml.getDoubleAttribute ("value", defaultValue));
+            }
+
+            juce::String getParameterID() const override { return id; }
+            float getValue() const override { return value.load (std::memory_order_relaxed); }
+            void setValue (const float newValue) override {
+                value.store (newValue, std::memory_order_relaxed);
+                sharedValue.store (newValue, std::memory_order_relaxed);
+            }
+            float getDefaultValue() const override { return defaultValue; }
+            juce::String getName (const int maximumStringLength) const override {
+                return name.substring (0, maximumStringLength);
+            }
+            juce::String getLabel() const override { return label; }
+            int getNumSteps() const override { return numSteps; }
+            bool isDiscrete() const override { return discrete; }
+            bool isBoolean() const override { return boolean; }
+            // The plugin's own value to text conversion would take a round trip to the sandbox
+            juce::String getText (const float normalisedValue, const int) const override {
+                return juce::String (normalisedValue, 3);
+            }
+            float getValueForText (const juce::String& text) const override { return text.getFloatValue(); }
+
+        private:
+            const juce::String id, name, label;
+            const float defaultValue;
+            const int numSteps;
+            const bool discrete, boolean;
+            std::atomic<float>& sharedValue;
+            std::atomic<float> value { 0.f };
+        };
+
+        const juce::PluginDescription description;
+        const CrashedCallback onCrashed;
+
+        SandboxSharedMemory memory;
+        std::unique_ptr<Coordinator> coordinator;
+        std::mutex requestMutex; // One control request at a time
+
+        std::unique_ptr<SandboxedParameter> bypassParameter;
+        bool pluginAcceptsMidi = false, pluginProducesMidi = false;
+        double tailLengthSeconds = 0.0;
+
+        uint32_t sequence     = 0; // Of the last block sent, only used by processBlock
+        double blockTimeoutMs = 50.0;
+        std::atomic<bool> crashed { false };
+        std::atomic<int> numDroppedBlocks { 0 };
+
+        SandboxedPluginInstance (const juce::PluginDescription& pluginDescription, CrashedCallback oC)
+            : juce::AudioPluginInstance (getBusesProperties (pluginDescription)),
+              description (pluginDescription),
+              onCrashed (std::move (oC)) {}
+
+        static BusesProperties getBusesProperties (const juce::PluginDescription& pluginDescription) {
+            BusesProperties buses;
+            if (pluginDescription.numInputChannels > 0)
+                buses = buses.withInput ("Input",
+                    juce::AudioChannelSet::canonicalChannelSet (pluginDescription.numInputChannels),
+                    true);
+            if (pluginDescription.numOutputChannels > 0)
+                buses = buses.withOutput ("Output",
+                    juce::AudioChannelSet::canonicalChannelSet (pluginDescription.numOutputChannels),
+                    true);
+            return buses;
+        }
+
+        // Returns an error message, empty on success
+        juce::String load (const double sampleRate, const int blockSize) {
+            if (!memory.create (SandboxSharedMemory::createUniqueName()))
+                return "Could not create the shared memory for the plugin sandbox";
+
+            coordinator = std::make_unique<Coordinator> (*this);
+            if (!coordinator->launchWorkerProcess (getPluginScannerExecutable(), SANDBOX_PROCESS_UID, 0, 0))
+                return "Could not start the plugin sandbox";
+
+            juce::MemoryBlock request;
+            {
+                juce::MemoryOutputStream stream (request, false);
+                stream.writeString (SandboxCommand::load);
+                stream.writeString (description.createXml()->toString());
+                stream.writeDouble (sampleRate);
+                stream.writeInt (blockSize);
+                stream.writeString (memory.getName());
+            }
+
+            const auto reply = sendRequest (request, LOAD_TIMEOUT_MS);
+            if (!reply) return "The plugin sandbox didn't respond, or crashed while loading the plugin";
+
+            juce::MemoryInputStream stream (*reply, false);
+            const auto success      = stream.readBool();
+            const auto errorMessage = stream.readString();
+            if (!success)
+                return errorMessage.isNotEmpty() ? errorMessage : "The plugin sandbox failed to load the plugin";
+
+            setLatencySamples (stream.readInt());
+            tailLengthSeconds  = stream.readDouble();
+            pluginAcceptsMidi  = stream.readBool();
+            pluginProducesMidi = stream.readBool();
+
+            auto* block = memory.get();
+            if (const auto parameters = juce::parseXML (stream.readString())) {
+                int index = 0;
+                for (const auto* parameter : parameters->getChildIterator()) {
+                    if (index >= SandboxBlock::maxParameters) break;
+                    addHostedParameter (
+                        std::make_unique<SandboxedParameter> (*parameter, block->parameterValues[index++]));
+                }
+            }
+
+            juce::XmlElement bypass ("PARAM");
+            bypass.setAttribute ("id", "sandboxBypass");
+            bypass.setAttribute ("name", "Bypass");
+            bypass.setAttribute ("boolean", true);
+            bypass.setAttribute ("discrete", true);
+            bypass.setAttribute ("numSteps", 2);
+            bypassParameter = std::make_unique<SandboxedParameter> (bypass, block->bypassValue);
+
+            updateBlockTimeout (sampleRate, blockSize);
+            return {};
+        }
+
+        std::optional<juce::MemoryBlock> sendRequest (const juce::MemoryBlock& request, const int timeoutMs) {
+            TIMEOFFAUDIO_TRACE_SCOPE ("sandbox", "sandboxRoundTrip");
+            const std::lock_guard lock (requestMutex);
+            if (crashed.load() || !coordinator) return std::nullopt;
+            return coordinator->sendAndWaitForReply (request, timeoutMs);
+        }
+
+        // A block may take a few times its duration in the sandbox before being given up on
+        void updateBlockTimeout (const double sampleRate, const int blockSize) {
+            if (sampleRate > 0) blockTimeoutMs = juce::jmax (10.0, 4000.0 * blockSize / sampleRate);
+        }
+
+        void dropBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) /* context: realtime */ {
+            buffer.clear();
+            midiMessages.clear();
+            numDroppedBlocks.fetch_add (1, std::memory_order_relaxed);
+        }
+
+        // Called on the connection's thread
+        void sandboxLost() {
+            crashed.store (true);
+            triggerAsyncUpdate();
+        }
+
+        void handleAsyncUpdate() override {
+            if (onCrashed) onCrashed (*this);
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SandboxedPluginInstance)
+    };
+}
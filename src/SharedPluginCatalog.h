@@ -0,0 +1,190 @@
+#pragma once
+#include "PluginCatalog.h"
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <juce_events/juce_events.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace timeoffaudio {
+    /*
+        One KnownPluginList (and PluginCatalog index) per plugin list file, shared by every PluginHost in the process
+        that uses that file. This matters when the host is itself a plugin, loaded many times per DAW project: the
+        list is parsed once, and every instance sees the others' scan results as soon as they come in.
+
+        Instances are reference-counted, getFor() hands out the open catalog of a file if there is one, and the last
+        PluginHost to let go of it closes it.
+
+        Across processes (i.e. several DAWs, or sandboxed plugin hosts), the file is only read and written while
+        holding an InterProcessLock, and written atomically. Changes made by other processes are picked up by
+        polling the file's modification time. If both sides changed the list meanwhile, plugins are merged rather
+        than overwritten, so that concurrent scans don't clobber each other's results.
+
+        Create, use and destroy it on the message thread.
+    */
+    class SharedPluginCatalog final : private juce::ChangeListener, private juce::Timer {
+    public:
+        using CustomScannerFactory = std::function<std::unique_ptr<juce::KnownPluginList::CustomScanner>()>;
+
+        class Listener {
+        public:
+            virtual ~Listener() = default;
+            // Called whenever the list changed, from this process or another one
+            virtual void pluginListChanged (const juce::Array<juce::PluginDescription>& types,
+                const PluginCatalog::Delta& delta) = 0;
+        };
+
+        // Returns the catalog of the given file, loading it if nothing else in the process has it open. The custom
+        // scanner is only created for a newly opened catalog.
+        static std::shared_ptr<SharedPluginCatalog> getFor (const juce::File& pluginListFile,
+            const CustomScannerFactory& createScanner = {}) {
+            const std::lock_guard lock (getRegistryMutex());
+            auto& registry = getRegistry();
+
+            for (auto it = registry.begin(); it != registry.end();)
+                it = it->second.expired() ? registry.erase (it) : std::next (it);
+
+            auto& entry = registry[pluginListFile.getFullPathName()];
+            if (auto catalog = entry.lock()) return catalog;
+
+            // The constructor is private, so make_shared can't be used
+            std::shared_ptr<SharedPluginCatalog> catalog (new SharedPluginCatalog (pluginListFile, createScanner));
+            entry = catalog;
+            return catalog;
+        }
+
+        ~SharedPluginCatalog() override {
+            stopTimer();
+            list.removeChangeListener (this);
+
+            // Changes still waiting for their change message
+            save();
+        }
+
+        juce::KnownPluginList& getList() { return list; }
+        const PluginCatalog& getCatalog() const { return catalog; }
+
+        void addListener (Listener* listener) { listeners.add (listener); }
+        void removeListener (Listener* listener) { listeners.remove (listener); }
+
+    private:
+        static constexpr int POLL_INTERVAL_MS = 2000;
+
+        const juce::File file;
+        juce::KnownPluginList list;
+        PluginCatalog catalog;
+        juce::ListenerList<Listener> listeners;
+
+        juce::InterProcessLock fileLock;
+        juce::Time lastSyncedModificationTime; // Of the file, as of our last read or write
+        juce::String lastSyncedContent;        // Of the list, as of our last read or write
+
+        SharedPluginCatalog (const juce::File& pluginListFile, const CustomScannerFactory& createScanner)
+            : file (pluginListFile),
+              fileLock ("timeoffaudioPluginList" + juce::String::toHexString (file.getFullPathName().hashCode64())) {
+            if (createScanner) list.setCustomScanner (createScanner());
+
+            {
+                const juce::InterProcessLock::ScopedLockType lock (fileLock);
+                if (const auto savedPluginList = juce::parseXML (file)) list.recreateFromXml (*savedPluginList);
+                lastSyncedModificationTime = file.getLastModificationTime();
+                if (file.existsAsFile()) lastSyncedContent = getContent();
+            }
+
+            catalog.update (list.getTypes());
+            list.addChangeListener (this);
+            if (!file.existsAsFile()) save();
+
+            startTimer (POLL_INTERVAL_MS);
+        }
+
+        juce::String getContent() const {
+            const auto xml = list.createXml();
+            return xml ? xml->toString() : juce::String();
+        }
+
+        void changeListenerCallback (juce::ChangeBroadcaster*) override {
+            save();
+
+            // Only the plugins that changed get reindexed
+            const auto types = list.getTypes();
+            const auto delta = catalog.update (types);
+            listeners.call ([&] (Listener& listener) { listener.pluginListChanged (types, delta); });
+        }
+
+        void save() {
+            auto content = getContent();
+            if (content.isEmpty() || content == lastSyncedContent) return;
+
+            const juce::InterProcessLock::ScopedLockType lock (fileLock);
+
+            // Another process saved its changes since we last synced, keep its plugins too
+            if (file.getLastModificationTime() != lastSyncedModificationTime)
+                if (const auto savedPluginList = juce::parseXML (file); savedPluginList && merge (*savedPluginList))
+                    content = getContent();
+
+            // replaceWithText writes to a temporary file and moves it over the target, so readers never see half a list
+            if (!file.create().wasOk() || !file.replaceWithText (content)) {
+                jassertfalse;
+                return;
+            }
+
+            lastSyncedContent          = content;
+            lastSyncedModificationTime = file.getLastModificationTime();
+        }
+
+        // Picks up changes saved by other processes
+        void timerCallback() override {
+            if (file.getLastModificationTime() == lastSyncedModificationTime) return;
+
+            const juce::InterProcessLock::ScopedLockType lock (fileLock);
+            lastSyncedModificationTime = file.getLastModificationTime();
+
+            const auto savedPluginList = juce::parseXML (file);
+            if (!savedPluginList) return;
+
+            // With changes of our own still to save, merge, so that the next save keeps both
+            if (getContent() != lastSyncedContent) {
+                merge (*savedPluginList);
+                return;
+            }
+
+            // Otherwise take the file as it is, including plugins other processes removed. The change message this
+            // sends doesn't save the list again, as it's in sync.
+            list.recreateFromXml (*savedPluginList);
+            lastSyncedContent = getContent();
+        }
+
+        // Adds the plugins and blacklistings of a saved list that this one doesn't have, returns true if any
+        bool merge (const juce::XmlElement& savedPluginList) {
+            juce::KnownPluginList saved;
+            saved.recreateFromXml (savedPluginList);
+
+            auto changed = false;
+            for (const auto& type : saved.getTypes())
+                if (list.getTypeForIdentifierString (type.createIdentifierString()) == nullptr)
+                    changed |= list.addType (type);
+
+            for (const auto& blacklisted : saved.getBlacklistedFiles()) {
+                if (list.getBlacklistedFiles().contains (blacklisted)) continue;
+                list.addToBlacklist (blacklisted);
+                changed = true;
+            }
+
+            return changed;
+        }
+
+        static std::map<juce::String, std::weak_ptr<SharedPluginCatalog>>& getRegistry() {
+            static std::map<juce::String, std::weak_ptr<SharedPluginCatalog>> registry;
+            return registry;
+        }
+
+        static std::mutex& getRegistryMutex() {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SharedPluginCatalog)
+    };
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <juce_analytics/juce_analytics.h>
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace timeoffaudio {
+    struct TelemetryEvent {
+        juce::String name;
+        juce::StringPairArray parameters;
+        juce::Time time = juce::Time::getCurrentTime();
+    };
+
+    class TelemetrySink {
+    public:
+        virtual ~TelemetrySink() = default;
+
+        // Called on the telemetry thread, with a batch of events in the order they were logged
+        virtual void write (const std::vector<TelemetryEvent>& events) = 0;
+    };
+
+    /*
+        Forwards events to juce::Analytics, i.e. to the destinations the app registered there. juce::Analytics isn't
+        thread safe and apps add destinations on the message thread, so each batch is logged from there. Batches
+        written once the message loop has stopped are dropped.
+    */
+    class AnalyticsTelemetrySink final : public TelemetrySink {
+    public:
+        void write (const std::vector<TelemetryEvent>& events) override {
+            juce::MessageManager::callAsync ([events] {
+                for (const auto& event : events)
+                    juce::Analytics::getInstance()->logEvent (event.name, event.parameters);
+            });
+        }
+    };
+
+    /*
+        Appends events to a local file, one JSON object per line, so that e.g. slow loading plugins can be analysed
+        across machines by collecting the files. Once the file grows past maxFileBytes, it's moved aside (replacing
+        the previous one) and a new one is started.
+    */
+    class FileTelemetrySink final : public TelemetrySink {
+    public:
+        explicit FileTelemetrySink (const juce::File& fileToWriteTo, const juce::int64 maxFileBytesToKeep = 16 << 20)
+            : file (fileToWriteTo), maxFileBytes (maxFileBytesToKeep) {}
+
+        void write (const std::vector<TelemetryEvent>& events) override {
+            juce::String lines;
+            for (const auto& event : events) {
+                auto object = std::make_unique<juce::DynamicObject>();
+                object->setProperty ("event", event.name);
+                object->setProperty ("time", event.time.toISO8601 (true));
+                for (const auto& key : event.parameters.getAllKeys())
+                    object->setProperty (key, event.parameters[key]);
+
+                lines << juce::JSON::toString (juce::var (object.release()), true) << "\n";
+            }
+
+            if (file.getSize() > maxFileBytes)
+                file.moveFileTo (file.getSiblingFile (file.getFileNameWithoutExtension() + ".previous")
+                                     .withFileExtension (file.getFileExtension()));
+
+            if (!file.appendText (lines, false, false, "\n")) jassertfalse;
+        }
+
+    private:
+        const juce::File file;
+        const juce::int64 maxFileBytes;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FileTelemetrySink)
+    };
+
+    /*
+        Hands events to the sinks in batches, on a background thread, so that logging an event only takes a lock
+        and a copy on the calling thread (never the realtime one). The thread starts with the first event.
+
+        Events are flushed every flushIntervalMs, or as soon as batchSize of them are queued. If the sinks fall
+        behind by more than maxQueuedEvents, new events are dropped and counted (see getNumDroppedEvents).
+        Events still queued when the pipeline is destroyed are flushed on the destroying thread.
+    */
+    class TelemetryPipeline final : private juce::Thread {
+    public:
+        struct Options {
+            int flushIntervalMs    = 2000;
+            size_t batchSize       = 64;
+            size_t maxQueuedEvents = 4096;
+        };
+
+        explicit TelemetryPipeline (const Options& optionsToUse = {})
+            : juce::Thread ("telemetry"), options (optionsToUse) {}
+
+        ~TelemetryPipeline() override {
+            stopThread (options.flushIntervalMs + 1000);
+            flush();
+        }
+
+        void addSink (std::unique_ptr<TelemetrySink> sink) {
+            const std::lock_guard lock (sinksMutex);
+            sinks.push_back (std::move (sink));
+        }
+
+        void log (TelemetryEvent event) {
+            {
+                const std::lock_guard lock (queueMutex);
+                if (queue.size() >= options.maxQueuedEvents) {
+                    ++numDroppedEvents;
+                    return;
+                }
+
+                queue.push_back (std::move (event));
+                if (queue.size() >= options.batchSize) notify();
+            }
+
+            if (!isThreadRunning()) startThread (juce::Thread::Priority::background);
+        }
+
+        int getNumDroppedEvents() const {
+            const std::lock_guard lock (queueMutex);
+            return numDroppedEvents;
+        }
+
+    private:
+        const Options options;
+
+        mutable std::mutex queueMutex;
+        std::vector<TelemetryEvent> queue;
+        int numDroppedEvents = 0;
+
+        // Held while writing a batch, so sinks only ever get called from one thread at a time
+        std::mutex sinksMutex;
+        std::vector<std::unique_ptr<TelemetrySink>> sinks;
+
+        void run() override {
+            while (!threadShouldExit()) {
+                wait (options.flushIntervalMs);
+                flush();
+            }
+        }
+
+        void flush() {
+            std::vector<TelemetryEvent> batch;
+            {
+                const std::lock_guard lock (queueMutex);
+                batch.swap (queue);
+            }
+
+            if (batch.empty()) return;
+
+            const std::lock_guard lock (sinksMutex);
+            for (const auto& sink : sinks) sink->write (batch);
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TelemetryPipeline)
+    };
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+
+// Set this to 0 to compile the tracing out entirely, in which case the TIMEOFFAUDIO_TRACE_* macros expand to nothing
+#ifndef TIMEOFFAUDIO_ENABLE_TRACING
+    #define TIMEOFFAUDIO_ENABLE_TRACING 1
+#endif
+
+namespace timeoffaudio {
+    /*
+        Records spans of host activity (scans, scanner round trips, plugin creation, write access commits, block
+        processing, ...) from any thread, and writes them out as Chrome trace JSON, which chrome://tracing and
+        Perfetto (ui.perfetto.dev) can open, to see the whole timeline of e.g. a slow session load in one view.
+
+        Recording is off until start() is called. When it's off, a span costs an atomic load. When it's on, ending a
+        span claims the next slot of a fixed-size event buffer with an atomic increment and fills it in, so spans
+        can be recorded on the realtime thread: there are no locks or allocations. The buffer is allocated by the
+        first start() and kept from then on. Once it's full, further spans are dropped (and counted).
+
+        Span names and categories must be string literals, or otherwise outlive the recording. Details are copied,
+        truncated to MAX_DETAIL_BYTES.
+    */
+    class TraceRecorder {
+    public:
+        static constexpr int MAX_EVENTS       = 1 << 18;
+        static constexpr int MAX_DETAIL_BYTES = 64;
+
+        static TraceRecorder& getInstance() {
+            static TraceRecorder recorder;
+            return recorder;
+        }
+
+        // Discards whatever was recorded so far, and starts recording
+        void start() {
+            recording.store (false, std::memory_order_release);
+
+            if (events == nullptr) events = std::make_unique<Event[]> ((size_t) MAX_EVENTS);
+            for (int index = 0; index < getNumEventsUsed(); ++index)
+                events[index].isComplete.store (false, std::memory_order_relaxed);
+
+            nextEvent.store (0, std::memory_order_relaxed);
+            numDroppedEvents.store (0, std::memory_order_relaxed);
+            recordingStartTicks = juce::Time::getHighResolutionTicks();
+            recording.store (true, std::memory_order_release);
+        }
+
+        // Stops recording, and writes what was recorded to the given file as Chrome trace JSON
+        bool stop (const juce::File& traceFile) {
+            recording.store (false, std::memory_order_release);
+
+            juce::FileOutputStream stream (traceFile);
+            if (!stream.openedOk()) return false;
+
+            stream.setPosition (0);
+            stream.truncate();
+            writeChromeTrace (stream);
+            return stream.getStatus().wasOk();
+        }
+
+        bool isRecording() const noexcept { return recording.load (std::memory_order_acquire); }
+
+        // The spans that didn't fit in the event buffer, since start()
+        uint64_t getNumDroppedEvents() const noexcept { return numDroppedEvents.load (std::memory_order_relaxed); }
+
+        void addSpan (const char* category,
+            const char* name,
+            const juce::int64 startTicks,
+            const juce::int64 endTicks,
+            const juce::String& detail = {}) noexcept /* context: realtime */ {
+            if (!isRecording()) return;
+
+            // Only claims an index while there's room, so that nextEvent stays within a few threads of MAX_EVENTS
+            // however long the recording, rather than eventually wrapping around
+            const auto index = nextEvent.load (std::memory_order_relaxed) < MAX_EVENTS
+                                   ? nextEvent.fetch_add (1, std::memory_order_relaxed)
+                                   : MAX_EVENTS;
+            if (index >= MAX_EVENTS) {
+                numDroppedEvents.fetch_add (1, std::memory_order_relaxed);
+                return;
+            }
+
+            auto& event      = events[index];
+            event.category   = category;
+            event.name       = name;
+            event.startTicks = startTicks;
+            event.endTicks   = endTicks;
+            event.threadId   = (uint64_t) (juce::pointer_sized_uint) juce::Thread::getCurrentThreadId();
+            event.detail[0]  = 0;
+            if (detail.isNotEmpty()) detail.copyToUTF8 (event.detail, MAX_DETAIL_BYTES);
+            event.isComplete.store (true, std::memory_order_release);
+        }
+
+        // Records a span from its construction to its destruction, use it via the TIMEOFFAUDIO_TRACE_* macros
+        class ScopedSpan {
+        public:
+            ScopedSpan (const char* categoryToUse, const char* nameToUse, const juce::String& detailToUse = {}) noexcept
+                : category (categoryToUse),
+                  name (nameToUse),
+                  detail (detailToUse),
+                  startTicks (getInstance().isRecording() ? juce::Time::getHighResolutionTicks() : 0) {}
+
+            ~ScopedSpan() {
+                if (startTicks != 0)
+                    getInstance().addSpan (category, name, startTicks, juce::Time::getHighResolutionTicks(), detail);
+            }
+
+        private:
+            const char* category;
+            const char* name;
+            const juce::String detail;
+            const juce::int64 startTicks;
+
+            JUCE_DECLARE_NON_COPYABLE (ScopedSpan)
+        };
+
+    private:
+        struct Event {
+            const char* category   = nullptr;
+            const char* name       = nullptr;
+            juce::int64 startTicks = 0, endTicks = 0;
+            uint64_t threadId      = 0;
+            char detail[MAX_DETAIL_BYTES] {};
+            std::atomic<bool> isComplete { false };
+        };
+
+        std::unique_ptr<Event[]> events;
+        std::atomic<int> nextEvent { 0 };
+        std::atomic<uint64_t> numDroppedEvents { 0 };
+        std::atomic<bool> recording { false };
+        juce::int64 recordingStartTicks = 0;
+
+        TraceRecorder() = default;
+
+        int getNumEventsUsed() const { return juce::jmin (MAX_EVENTS, nextEvent.load (std::memory_order_relaxed)); }
+
+        void writeChromeTrace (juce::OutputStream& stream) const {
+            const auto toMicros = [this] (const juce::int64 ticks) {
+                return juce::Time::highResolutionTicksToSeconds (ticks - recordingStartTicks) * 1.0e6;
+            };
+
+            // Threads get small, stable ids in the order they show up, the message thread is named
+            std::map<uint64_t, int> threadIds;
+            const auto getThreadId = [&] (const uint64_t threadId) {
+                return threadIds.emplace (threadId, (int) threadIds.size() + 1).first->second;
+            };
+
+            stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            auto isFirstEvent = true;
+            const auto separate = [&] {
+                if (!isFirstEvent) stream << ",\n";
+                isFirstEvent = false;
+            };
+
+            if (const auto* messageManager = juce::MessageManager::getInstanceWithoutCreating()) {
+                separate();
+                stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                       << getThreadId ((uint64_t) (juce::pointer_sized_uint) messageManager->getCurrentMessageThread())
+                       << ",\"args\":{\"name\":\"message thread\"}}";
+            }
+
+            for (int index = 0; index < getNumEventsUsed(); ++index) {
+                const auto& event = events[index];
+                if (!event.isComplete.load (std::memory_order_acquire)) continue;
+
+                separate();
+                stream << "{\"name\":" << juce::JSON::toString (juce::String (event.name))
+                       << ",\"cat\":" << juce::JSON::toString (juce::String (event.category))
+                       << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << getThreadId (event.threadId)
+                       << ",\"ts\":" << juce::String (toMicros (event.startTicks), 3)
+                       << ",\"dur\":" << juce::String (toMicros (event.endTicks) - toMicros (event.startTicks), 3);
+                if (event.detail[0] != 0)
+                    stream << ",\"args\":{\"detail\":"
+                           << juce::JSON::toString (juce::String::fromUTF8 (event.detail)) << "}";
+                stream << "}";
+            }
+
+            stream << "]}\n";
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TraceRecorder)
+    };
+}
+
+#if TIMEOFFAUDIO_ENABLE_TRACING
+    #define TIMEOFFAUDIO_TRACE_SCOPE(category, name)                                                                   \
+        const timeoffaudio::TraceRecorder::ScopedSpan JUCE_JOIN_MACRO (traceSpan, __LINE__) (category, name)
+    #define TIMEOFFAUDIO_TRACE_SCOPE_WITH_DETAIL(category, name, detail)                                               \
+        const timeoffaudio::TraceRecorder::ScopedSpan JUCE_JOIN_MACRO (traceSpan, __LINE__) (category, name, detail)
+#else
+    #define TIMEOFFAUDIO_TRACE_SCOPE(category, name)
+    #define TIMEOFFAUDIO_TRACE_SCOPE_WITH_DETAIL(category, name, detail)
+#endif
@@ -0,0 +1,115 @@
+#pragma once
+#include "../RealtimeSanitizer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/*
+    Counts heap allocations made through operator new, in total and on threads marked as realtime.
+
+    This replaces the global operator new/delete, so it must be included from exactly one translation unit of the
+    executable that uses it. When the realtime sanitizer is enabled, it owns those replacements instead, and the
+    realtime counts come from the allocations it flagged inside withRealtimeAccess.
+*/
+namespace timeoffaudio::benchmark {
+    class AllocationCounter {
+    public:
+        struct Counts {
+            size_t numAllocations = 0, numBytes = 0;
+        };
+
+        // Marks the current thread as realtime for the lifetime of this object
+        class ScopedRealtimeThread {
+        public:
+            ScopedRealtimeThread() noexcept { ++realtimeDepth(); }
+            ~ScopedRealtimeThread() noexcept { --realtimeDepth(); }
+        };
+
+        static Counts getTotal() noexcept {
+            return { total().numAllocations.load(), total().numBytes.load() };
+        }
+
+        static Counts getRealtime() noexcept {
+#if TIMEOFFAUDIO_REALTIME_SANITIZER
+            using Sanitizer = timeoffaudio::RealtimeSanitizer;
+            return { (size_t) Sanitizer::getNumViolations (Sanitizer::ViolationType::allocation),
+                Sanitizer::getNumBytesAllocated() };
+#else
+            return { realtime().numAllocations.load(), realtime().numBytes.load() };
+#endif
+        }
+
+        static void reset() noexcept {
+            for (auto* counter : { &total(), &realtime() }) {
+                counter->numAllocations.store (0);
+                counter->numBytes.store (0);
+            }
+        }
+
+        static void allocated (size_t size) noexcept {
+            total().add (size);
+            if (realtimeDepth() > 0) realtime().add (size);
+        }
+
+    private:
+        struct AtomicCounts {
+            std::atomic<size_t> numAllocations { 0 }, numBytes { 0 };
+
+            void add (size_t size) noexcept {
+                numAllocations.fetch_add (1, std::memory_order_relaxed);
+                numBytes.fetch_add (size, std::memory_order_relaxed);
+            }
+        };
+
+        static AtomicCounts& total() noexcept {
+            static AtomicCounts counts;
+            return counts;
+        }
+
+        static AtomicCounts& realtime() noexcept {
+            static AtomicCounts counts;
+            return counts;
+        }
+
+        static int& realtimeDepth() noexcept {
+            thread_local int depth = 0;
+            return depth;
+        }
+    };
+}
+
+#if !TIMEOFFAUDIO_REALTIME_SANITIZER
+void* operator new (std::size_t size) {
+    timeoffaudio::benchmark::AllocationCounter::allocated (size);
+    if (auto* ptr = std::malloc (size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new (std::size_t size, std::align_val_t alignment) {
+    timeoffaudio::benchmark::AllocationCounter::allocated (size);
+    const auto align = std::max ((std::size_t) alignment, sizeof (void*));
+#if defined(_WIN32)
+    if (auto* ptr = _aligned_malloc (size == 0 ? 1 : size, align)) return ptr;
+#else
+    void* ptr = nullptr;
+    if (posix_memalign (&ptr, align, size == 0 ? 1 : size) == 0) return ptr;
+#endif
+    throw std::bad_alloc();
+}
+
+void operator delete (void* ptr) noexcept { std::free (ptr); }
+void operator delete (void* ptr, std::size_t) noexcept { std::free (ptr); }
+
+void operator delete (void* ptr, std::align_val_t) noexcept {
+#if defined(_WIN32)
+    _aligned_free (ptr);
+#else
+    std::free (ptr);
+#endif
+}
+
+void operator delete (void* ptr, std::size_t, std::align_val_t alignment) noexcept {
+    operator delete (ptr, alignment);
+}
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+#include "../../pluginhost.h"
+#include "TestPluginFormat.h"
+
+#include <unordered_map>
+
+namespace timeoffaudio::benchmark {
+    /*
+        A PluginHost loaded with a chain of built-in test processors, where each node feeds the next one.
+        Keys are "node-0", "node-1", etc. in chain order.
+    */
+    class BenchmarkHost {
+    public:
+        BenchmarkHost (double sampleRate, int blockSize)
+            : pluginListFile (juce::File::createTempFile (".xml")),
+              host (
+                  pluginListFile,
+                  [this] (const PluginHost::KeyType& key, const PluginHost::TransientPluginMap&) {
+                      return getConnectionsFor (key);
+                  },
+                  [this] (const PluginHost::KeyType& key) { return getEnabledParameterFor (key); }) {
+            host.addFormat (std::make_unique<TestPluginFormat>());
+            host.prepare ((int) sampleRate, blockSize);
+        }
+
+        ~BenchmarkHost() { pluginListFile.deleteFile(); }
+
+        static PluginHost::KeyType getKey (size_t node) { return "node-" + std::to_string (node); }
+
+        static PluginWindow::Options getWindowOptions() {
+            PluginWindow::Options windowOptions;
+            windowOptions.openAutomatically = false;
+            return windowOptions;
+        }
+
+        // Appends the given processors to the chain, returns true if they all loaded
+        bool load (const juce::StringArray& graph, int numChannels) {
+            const auto firstNode = keys.size();
+            for (int index = 0; index < graph.size(); ++index) {
+                const auto node            = keys.size();
+                nodeIndices[getKey (node)] = node;
+                keys.push_back (getKey (node));
+            }
+
+            host.withWriteAccess (
+                [&] (PluginHost::TransientPluginMap& pluginMap) {
+                    for (size_t node = firstNode; node < keys.size(); ++node)
+                        host.createPluginInstance (pluginMap,
+                            TestPluginFormat::createDescription (graph[(int) (node - firstNode)], numChannels),
+                            keys[node],
+                            getWindowOptions());
+                },
+                PluginHost::PostUpdateAction::RefreshConnections);
+
+            size_t numLoaded = 0;
+            host.withReadonlyAccess ([&] (const PluginHost::PluginMap& pluginMap) { numLoaded = pluginMap.size(); });
+            return numLoaded == keys.size();
+        }
+
+        PluginHost& getHost() { return host; }
+        const std::vector<PluginHost::KeyType>& getKeys() const { return keys; }
+
+    private:
+        juce::File pluginListFile;
+        std::vector<PluginHost::KeyType> keys;
+        std::unordered_map<PluginHost::KeyType, size_t> nodeIndices;
+        std::map<PluginHost::KeyType, std::unique_ptr<juce::AudioParameterBool>> enabledParameters;
+        PluginHost host;
+
+        PluginHost::Plugin::ConnectionList getConnectionsFor (const PluginHost::KeyType& key) const {
+            const auto node = nodeIndices.find (key);
+            if (node == nodeIndices.end() || node->second + 1 >= keys.size()) return {};
+            return PluginHost::Plugin::ConnectionList {}.insert (keys[node->second + 1]);
+        }
+
+        juce::RangedAudioParameter* getEnabledParameterFor (const PluginHost::KeyType& key) {
+            auto& parameter = enabledParameters[key];
+            if (parameter == nullptr)
+                parameter = std::make_unique<juce::AudioParameterBool> (juce::ParameterID { key, 1 }, key, true);
+            return parameter.get();
+        }
+
+        JUCE_DECLARE_NON_COPYABLE (BenchmarkHost)
+    };
+}
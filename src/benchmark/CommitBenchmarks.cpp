@@ -0,0 +1,240 @@
+#include "AllocationCounter.h"
+#include "BenchmarkHost.h"
+#include <benchmark/benchmark.h>
+
+/*
+    Microbenchmarks for the commit path of PluginHost, i.e. withWriteAccess and the immer map operations behind
+    createPluginInstance, deletePluginInstance, movePluginInstance, openPluginWindow and connection refreshes.
+
+    Each benchmark runs against a host preloaded with state.range (0) plugins, and reports the time and the number
+    of allocations per operation. The work needed to reset the host between iterations is neither timed nor counted.
+*/
+namespace timeoffaudio::benchmark {
+    namespace {
+        // Only counts the allocations made between resume() and pause()
+        class AllocationTracker {
+        public:
+            void resume() { start = AllocationCounter::getTotal(); }
+
+            void pause() {
+                const auto now = AllocationCounter::getTotal();
+                numAllocations += now.numAllocations - start.numAllocations;
+                numBytes += now.numBytes - start.numBytes;
+            }
+
+            void report (::benchmark::State& state) const {
+                state.counters["allocs"] =
+                    ::benchmark::Counter ((double) numAllocations, ::benchmark::Counter::kAvgIterations);
+                state.counters["allocBytes"] =
+                    ::benchmark::Counter ((double) numBytes, ::benchmark::Counter::kAvgIterations);
+            }
+
+        private:
+            AllocationCounter::Counts start;
+            size_t numAllocations = 0, numBytes = 0;
+        };
+
+        std::unique_ptr<BenchmarkHost> createHost (const ::benchmark::State& state) {
+            auto benchmarkHost = std::make_unique<BenchmarkHost> (48'000.0, 128);
+
+            juce::StringArray graph;
+            for (int64_t node = 0; node < state.range (0); ++node) graph.add ("gain");
+
+            const auto loaded = benchmarkHost->load (graph, 2);
+            jassert (loaded);
+            juce::ignoreUnused (loaded);
+
+            return benchmarkHost;
+        }
+
+        // Hands the latest commit to the "realtime" side and releases the retired maps, as the audio thread and the
+        // host's timer would, so that the synchronisation queues never fill up
+        void settle (PluginHost& host) {
+            host.withRealtimeAccess ([] (const PluginHost::PluginMap&) {});
+            host.releaseRetiredPluginMaps();
+        }
+    }
+
+    static void BM_Commit (::benchmark::State& state) {
+        const auto benchmarkHost = createHost (state);
+        auto& host               = benchmarkHost->getHost();
+        AllocationTracker allocations;
+
+        for (auto _ : state) {
+            allocations.resume();
+            host.withWriteAccess ([] (PluginHost::TransientPluginMap&) {});
+            allocations.pause();
+
+            state.PauseTiming();
+            settle (host);
+            state.ResumeTiming();
+        }
+
+        allocations.report (state);
+    }
+
+    static void BM_CreatePlugin (::benchmark::State& state) {
+        const auto benchmarkHost = createHost (state);
+        auto& host               = benchmarkHost->getHost();
+        const auto key           = BenchmarkHost::getKey ((size_t) state.range (0));
+        const auto description   = TestPluginFormat::createDescription ("gain", 2);
+        AllocationTracker allocations;
+
+        for (auto _ : state) {
+            allocations.resume();
+            host.withWriteAccess ([&] (PluginHost::TransientPluginMap& pluginMap) {
+                host.createPluginInstance (pluginMap, description, key, BenchmarkHost::getWindowOptions());
+            });
+            allocations.pause();
+
+            state.PauseTiming();
+            host.deletePluginInstance (key);
+            settle (host);
+            state.ResumeTiming();
+        }
+
+        allocations.report (state);
+    }
+
+    static void BM_DeletePlugin (::benchmark::State& state) {
+        const auto benchmarkHost = createHost (state);
+        auto& host               = benchmarkHost->getHost();
+        const auto key           = BenchmarkHost::getKey ((size_t) state.range (0));
+        const auto description   = TestPluginFormat::createDescription ("gain", 2);
+        AllocationTracker allocations;
+
+        for (auto _ : state) {
+            state.PauseTiming();
+            host.withWriteAccess ([&] (PluginHost::TransientPluginMap& pluginMap) {
+                host.createPluginInstance (pluginMap, description, key, BenchmarkHost::getWindowOptions());
+            });
+            settle (host);
+            state.ResumeTiming();
+
+            allocations.resume();
+            host.deletePluginInstance (key);
+            allocations.pause();
+
+            state.PauseTiming();
+            settle (host);
+            state.ResumeTiming();
+        }
+
+        allocations.report (state);
+    }
+
+    // Moves the first plugin back and forth between its key and a free one
+    static void BM_MovePlugin (::benchmark::State& state) {
+        const auto benchmarkHost = createHost (state);
+        auto& host               = benchmarkHost->getHost();
+        auto fromKey             = BenchmarkHost::getKey (0);
+        auto toKey               = BenchmarkHost::getKey ((size_t) state.range (0));
+        AllocationTracker allocations;
+
+        for (auto _ : state) {
+            allocations.resume();
+            host.movePluginInstance (fromKey, toKey);
+            allocations.pause();
+
+            state.PauseTiming();
+            settle (host);
+            std::swap (fromKey, toKey);
+            state.ResumeTiming();
+        }
+
+        allocations.report (state);
+    }
+
+    // Swaps the first two plugins
+    static void BM_SwapPlugins (::benchmark::State& state) {
+        if (state.range (0) < 2) return state.SkipWithError ("Swapping needs at least two plugins");
+
+        const auto benchmarkHost = createHost (state);
+        auto& host               = benchmarkHost->getHost();
+        const auto firstKey      = BenchmarkHost::getKey (0);
+        const auto secondKey     = BenchmarkHost::getKey (1);
+        AllocationTracker allocations;
+
+        for (auto _ : state) {
+            allocations.resume();
+            host.movePluginInstance (firstKey, secondKey);
+            allocations.pause();
+
+            state.PauseTiming();
+            settle (host);
+            state.ResumeTiming();
+        }
+
+        allocations.report (state);
+    }
+
+    // Re-opens the (already created) window of the first plugin
+    static void BM_OpenPluginWindow (::benchmark::State& state) {
+        if (juce::Desktop::getInstance().getDisplays().getPrimaryDisplay() == nullptr)
+            return state.SkipWithError ("Opening plugin windows needs a display");
+
+        const auto benchmarkHost = createHost (state);
+        auto& host               = benchmarkHost->getHost();
+        const auto key           = BenchmarkHost::getKey (0);
+        AllocationTracker allocations;
+
+        host.openPluginWindow (key, BenchmarkHost::getWindowOptions());
+        host.closePluginWindow (key);
+        settle (host);
+
+        for (auto _ : state) {
+            allocations.resume();
+            host.openPluginWindow (key, BenchmarkHost::getWindowOptions());
+            allocations.pause();
+
+            state.PauseTiming();
+            host.closePluginWindow (key);
+            settle (host);
+            state.ResumeTiming();
+        }
+
+        allocations.report (state);
+    }
+
+    static void BM_RefreshConnections (::benchmark::State& state) {
+        const auto benchmarkHost = createHost (state);
+        auto& host               = benchmarkHost->getHost();
+        AllocationTracker allocations;
+
+        for (auto _ : state) {
+            allocations.resume();
+            host.withWriteAccess (
+                [] (PluginHost::TransientPluginMap&) {}, PluginHost::PostUpdateAction::RefreshConnections);
+            allocations.pause();
+
+            state.PauseTiming();
+            settle (host);
+            state.ResumeTiming();
+        }
+
+        allocations.report (state);
+    }
+}
+
+#define TIMEOFFAUDIO_COMMIT_BENCHMARK(function) \
+    BENCHMARK (function)->RangeMultiplier (10)->Range (1, 10'000)->Unit (::benchmark::kMicrosecond)
+
+TIMEOFFAUDIO_COMMIT_BENCHMARK (timeoffaudio::benchmark::BM_Commit);
+TIMEOFFAUDIO_COMMIT_BENCHMARK (timeoffaudio::benchmark::BM_CreatePlugin);
+TIMEOFFAUDIO_COMMIT_BENCHMARK (timeoffaudio::benchmark::BM_DeletePlugin);
+TIMEOFFAUDIO_COMMIT_BENCHMARK (timeoffaudio::benchmark::BM_MovePlugin);
+TIMEOFFAUDIO_COMMIT_BENCHMARK (timeoffaudio::benchmark::BM_SwapPlugins);
+TIMEOFFAUDIO_COMMIT_BENCHMARK (timeoffaudio::benchmark::BM_OpenPluginWindow);
+TIMEOFFAUDIO_COMMIT_BENCHMARK (timeoffaudio::benchmark::BM_RefreshConnections);
+
+int main (int argc, char** argv) {
+    // The main thread doubles as the message thread, which PluginHost's write path asserts on
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    ::benchmark::Initialize (&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments (argc, argv)) return 1;
+
+    ::benchmark::RunSpecifiedBenchmarks();
+    ::benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,231 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <thread>
+
+namespace timeoffaudio::benchmark {
+    /*
+        Built-in processors used to drive PluginHost without any real plugins installed.
+
+        Each processor is identified by a "type[:parameter]" string, which is used as the fileOrIdentifier of its
+        PluginDescription:
+        - gain[:linearGain]    multiplies the signal (default 0.5)
+        - fir[:numTaps]        direct-form FIR lowpass (default 32 taps)
+        - sleep[:micros]       sleeps for the given number of microseconds per block (default 100)
+        - spin[:micros]        busy-waits for the given number of microseconds per block (default 100)
+    */
+    class TestProcessor : public juce::AudioPluginInstance {
+    public:
+        TestProcessor (const juce::String& identifierToUse, int numChannels)
+            : AudioPluginInstance (BusesProperties()
+                      .withInput ("Input", juce::AudioChannelSet::canonicalChannelSet (numChannels), true)
+                      .withOutput ("Output", juce::AudioChannelSet::canonicalChannelSet (numChannels), true)),
+              identifier (identifierToUse) {}
+
+        void fillInPluginDescription (juce::PluginDescription& description) const override {
+            description.name              = identifier;
+            description.descriptiveName   = "Benchmark processor " + identifier;
+            description.pluginFormatName  = getFormatName();
+            description.category          = "Benchmark";
+            description.manufacturerName  = "time off audio";
+            description.version           = "1.0.0";
+            description.fileOrIdentifier  = identifier;
+            description.uniqueId          = identifier.hashCode();
+            description.deprecatedUid     = description.uniqueId;
+            description.isInstrument      = false;
+            description.numInputChannels  = getTotalNumInputChannels();
+            description.numOutputChannels = getTotalNumOutputChannels();
+        }
+
+        static juce::String getFormatName() { return "BenchmarkProcessors"; }
+
+        const juce::String getName() const override { return identifier; }
+        void releaseResources() override {}
+        double getTailLengthSeconds() const override { return 0.0; }
+        bool acceptsMidi() const override { return false; }
+        bool producesMidi() const override { return false; }
+        bool hasEditor() const override { return false; }
+        juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+        int getNumPrograms() override { return 1; }
+        int getCurrentProgram() override { return 0; }
+        void setCurrentProgram (int) override {}
+        const juce::String getProgramName (int) override { return {}; }
+        void changeProgramName (int, const juce::String&) override {}
+        void getStateInformation (juce::MemoryBlock&) override {}
+        void setStateInformation (const void*, int) override {}
+
+        juce::AudioProcessorParameter* getBypassParameter() const override { return &bypass; }
+
+        void processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer&) override {
+            if (bypass.get()) return;
+            process (buffer);
+        }
+
+    protected:
+        virtual void process (juce::AudioBuffer<float>& buffer) = 0;
+
+    private:
+        const juce::String identifier;
+        mutable juce::AudioParameterBool bypass { juce::ParameterID { "bypass", 1 }, "Bypass", false };
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TestProcessor)
+    };
+
+    class GainProcessor final : public TestProcessor {
+    public:
+        GainProcessor (const juce::String& identifier, int numChannels, float linearGain)
+            : TestProcessor (identifier, numChannels), gain (linearGain) {}
+
+        void prepareToPlay (double, int) override {}
+
+    private:
+        const float gain;
+
+        void process (juce::AudioBuffer<float>& buffer) override { buffer.applyGain (gain); }
+    };
+
+    class FirProcessor final : public TestProcessor {
+    public:
+        FirProcessor (const juce::String& identifier, int numChannels, int numTapsToUse)
+            : TestProcessor (identifier, numChannels), numTaps (juce::jmax (1, numTapsToUse)) {
+            // Windowed-sinc lowpass at a quarter of the sample rate
+            coefficients.resize ((size_t) numTaps);
+            const auto centre = (double) (numTaps - 1) * 0.5;
+            for (int tap = 0; tap < numTaps; ++tap) {
+                const auto x      = (double) tap - centre;
+                const auto sinc   = x == 0.0 ? 0.5 : std::sin (juce::MathConstants<double>::pi * 0.5 * x)
+                                                       / (juce::MathConstants<double>::pi * x);
+                const auto window = numTaps > 1 ? 0.5 - 0.5 * std::cos (juce::MathConstants<double>::twoPi * tap
+                                                                         / (double) (numTaps - 1))
+                                                : 1.0;
+                coefficients[(size_t) tap] = (float) (sinc * window);
+            }
+        }
+
+        void prepareToPlay (double, int maximumExpectedSamplesPerBlock) override {
+            maxBlockSize = maximumExpectedSamplesPerBlock;
+            history.setSize (getTotalNumOutputChannels(), numTaps - 1 + maxBlockSize);
+            history.clear();
+        }
+
+    private:
+        const int numTaps;
+        int maxBlockSize = 0;
+        std::vector<float> coefficients;
+        // Per channel: the last (numTaps - 1) input samples, followed by the current block
+        juce::AudioBuffer<float> history;
+
+        void process (juce::AudioBuffer<float>& buffer) override {
+            const auto numSamples = juce::jmin (buffer.getNumSamples(), maxBlockSize);
+            const auto numChannels = juce::jmin (buffer.getNumChannels(), history.getNumChannels());
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                auto* input  = history.getWritePointer (channel);
+                auto* output = buffer.getWritePointer (channel);
+
+                juce::FloatVectorOperations::copy (input + numTaps - 1, output, numSamples);
+
+                for (int sample = 0; sample < numSamples; ++sample) {
+                    const auto* x = input + sample + numTaps - 1;
+                    float sum     = 0.f;
+                    for (int tap = 0; tap < numTaps; ++tap) sum += coefficients[(size_t) tap] * x[-tap];
+                    output[sample] = sum;
+                }
+
+                std::memmove (input, input + numSamples, sizeof (float) * (size_t) (numTaps - 1));
+            }
+        }
+    };
+
+    class WaitProcessor final : public TestProcessor {
+    public:
+        WaitProcessor (const juce::String& identifier, int numChannels, int microsToWait, bool shouldSpin)
+            : TestProcessor (identifier, numChannels), micros (microsToWait), spin (shouldSpin) {}
+
+        void prepareToPlay (double, int) override {}
+
+    private:
+        const int micros;
+        const bool spin;
+
+        void process (juce::AudioBuffer<float>&) override {
+            if (!spin) return std::this_thread::sleep_for (std::chrono::microseconds (micros));
+
+            const auto endTicks = juce::Time::getHighResolutionTicks()
+                                  + juce::Time::secondsToHighResolutionTicks ((double) micros * 1.0e-6);
+            while (juce::Time::getHighResolutionTicks() < endTicks) {}
+        }
+    };
+
+    /*
+        Exposes the processors above as a local AudioPluginFormat, so they can be loaded through
+        PluginHost::createPluginInstance like any other plugin.
+    */
+    class TestPluginFormat final : public juce::AudioPluginFormat {
+    public:
+        static juce::PluginDescription createDescription (const juce::String& identifier, int numChannels) {
+            juce::PluginDescription description;
+            description.name              = identifier;
+            description.pluginFormatName  = TestProcessor::getFormatName();
+            description.fileOrIdentifier  = identifier;
+            description.uniqueId          = identifier.hashCode();
+            description.numInputChannels  = numChannels;
+            description.numOutputChannels = numChannels;
+            return description;
+        }
+
+        juce::String getName() const override { return TestProcessor::getFormatName(); }
+
+        void findAllTypesForFile (juce::OwnedArray<juce::PluginDescription>& results,
+            const juce::String& fileOrIdentifier) override {
+            if (fileMightContainThisPluginType (fileOrIdentifier))
+                results.add (new juce::PluginDescription (createDescription (fileOrIdentifier, 2)));
+        }
+
+        bool fileMightContainThisPluginType (const juce::String& fileOrIdentifier) override {
+            const auto type = fileOrIdentifier.upToFirstOccurrenceOf (":", false, false);
+            return type == "gain" || type == "fir" || type == "sleep" || type == "spin";
+        }
+
+        juce::String getNameOfPluginFromIdentifier (const juce::String& fileOrIdentifier) override {
+            return fileOrIdentifier;
+        }
+
+        bool pluginNeedsRescanning (const juce::PluginDescription&) override { return false; }
+        bool doesPluginStillExist (const juce::PluginDescription&) override { return true; }
+        bool canScanForPlugins() const override { return false; }
+        bool isTrivialToScan() const override { return true; }
+
+        juce::StringArray searchPathsForPlugins (const juce::FileSearchPath&, bool, bool) override { return {}; }
+        juce::FileSearchPath getDefaultLocationsToSearch() override { return {}; }
+
+    private:
+        void createPluginInstance (const juce::PluginDescription& description,
+            double,
+            int,
+            PluginCreationCallback callback) override {
+            const auto identifier  = description.fileOrIdentifier;
+            const auto type        = identifier.upToFirstOccurrenceOf (":", false, false);
+            const auto parameter   = identifier.fromFirstOccurrenceOf (":", false, false);
+            const auto numChannels = juce::jmax (1, description.numInputChannels);
+
+            std::unique_ptr<juce::AudioPluginInstance> instance;
+            if (type == "gain")
+                instance = std::make_unique<GainProcessor> (
+                    identifier, numChannels, parameter.isEmpty() ? 0.5f : parameter.getFloatValue());
+            else if (type == "fir")
+                instance = std::make_unique<FirProcessor> (
+                    identifier, numChannels, parameter.isEmpty() ? 32 : parameter.getIntValue());
+            else if (type == "sleep" || type == "spin")
+                instance = std::make_unique<WaitProcessor> (
+                    identifier, numChannels, parameter.isEmpty() ? 100 : parameter.getIntValue(), type == "spin");
+
+            if (instance == nullptr) return callback (nullptr, "Unknown benchmark processor: " + identifier);
+            callback (std::move (instance), {});
+        }
+
+        bool requiresUnblockedMessageThreadDuringCreation (const juce::PluginDescription&) const override {
+            return false;
+        }
+    };
+}
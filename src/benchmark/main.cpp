@@ -0,0 +1,215 @@
+#include "AllocationCounter.h"
+#include "BenchmarkHost.h"
+#include <choc/text/choc_JSON.h>
+
+#include <iostream>
+#include <thread>
+
+/*
+    Headless offline render benchmark for PluginHost.
+
+    Loads a chain of built-in test processors (see TestPluginFormat.h) into a PluginHost, then drives
+    withRealtimeAccess and process from a dedicated audio thread for a fixed number of blocks, as fast as possible.
+    Reports throughput, the per-block latency distribution and the allocations made on the audio thread.
+
+    Usage:
+        PluginHostBenchmark [--graph gain:0.5,fir:64,sleep:50] [--blocks 10000] [--warmup 100]
+                            [--block-size 128] [--sample-rate 48000] [--channels 2] [--profile]
+                            [--fail-on-allocations]
+
+    With --fail-on-allocations, or when built with TIMEOFFAUDIO_REALTIME_SANITIZER, the exit code is non-zero if
+    anything allocated, deallocated or locked a mutex on the audio thread.
+*/
+namespace timeoffaudio::benchmark {
+    struct Options {
+        juce::StringArray graph { "gain", "fir:32" };
+        int numBlocks          = 10'000;
+        int numWarmupBlocks    = 100;
+        int blockSize          = 128;
+        int numChannels        = 2;
+        double sampleRate      = 48'000.0;
+        bool profile           = false;
+        bool failOnAllocations = false;
+
+        static Options fromArguments (const juce::ArgumentList& args) {
+            Options options;
+
+            if (args.containsOption ("--graph"))
+                options.graph = juce::StringArray::fromTokens (args.getValueForOption ("--graph"), ",", "");
+            if (args.containsOption ("--blocks")) options.numBlocks = args.getValueForOption ("--blocks").getIntValue();
+            if (args.containsOption ("--warmup"))
+                options.numWarmupBlocks = args.getValueForOption ("--warmup").getIntValue();
+            if (args.containsOption ("--block-size"))
+                options.blockSize = args.getValueForOption ("--block-size").getIntValue();
+            if (args.containsOption ("--channels"))
+                options.numChannels = args.getValueForOption ("--channels").getIntValue();
+            if (args.containsOption ("--sample-rate"))
+                options.sampleRate = args.getValueForOption ("--sample-rate").getDoubleValue();
+            options.profile           = args.containsOption ("--profile");
+            options.failOnAllocations = args.containsOption ("--fail-on-allocations");
+
+            options.graph.trim();
+            options.graph.removeEmptyStrings();
+            options.numBlocks       = juce::jmax (1, options.numBlocks);
+            options.numWarmupBlocks = juce::jmax (0, options.numWarmupBlocks);
+            options.blockSize       = juce::jmax (1, options.blockSize);
+            options.numChannels     = juce::jlimit (1, 8, options.numChannels);
+
+            return options;
+        }
+    };
+
+    struct Results {
+        double wallSeconds = 0.0;
+        std::vector<double> blockMicros;
+        AllocationCounter::Counts audioThreadAllocations;
+    };
+
+    class OfflineRenderHarness {
+    public:
+        explicit OfflineRenderHarness (const Options& o)
+            : options (o), benchmarkHost (options.sampleRate, options.blockSize) {}
+
+        bool load() { return benchmarkHost.load (options.graph, options.numChannels); }
+
+        Results run() {
+            Results results;
+            results.blockMicros.reserve ((size_t) options.numBlocks);
+
+            juce::AudioBuffer<float> source (options.numChannels, options.blockSize);
+            juce::AudioBuffer<float> buffer (options.numChannels, options.blockSize);
+            juce::MidiBuffer midiMessages;
+            midiMessages.ensureSize (1024);
+
+            juce::Random random (1234);
+            for (int channel = 0; channel < source.getNumChannels(); ++channel)
+                for (int sample = 0; sample < source.getNumSamples(); ++sample)
+                    source.setSample (channel, sample, random.nextFloat() * 2.f - 1.f);
+
+            auto& host = benchmarkHost.getHost();
+
+            const auto renderBlock = [&] {
+                for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+                    buffer.copyFrom (channel, 0, source, channel, 0, options.blockSize);
+                midiMessages.clear();
+
+                // The chain is compiled in processing order, so this is a linear walk over the graph's arrays, with
+                // each plugin reading the previous one's output in place
+                host.withRealtimeAccess ([&] (const RealtimePluginGraph& graph) {
+                    host.process (graph, buffer, midiMessages);
+                });
+            };
+
+            std::thread audioThread ([&] {
+                const juce::ScopedNoDenormals noDenormals;
+
+                for (int block = 0; block < options.numWarmupBlocks; ++block) renderBlock();
+
+                const AllocationCounter::ScopedRealtimeThread realtimeThread;
+                const auto allocationsBefore = AllocationCounter::getRealtime();
+                const auto startTicks        = juce::Time::getHighResolutionTicks();
+
+                for (int block = 0; block < options.numBlocks; ++block) {
+                    const auto blockStartTicks = juce::Time::getHighResolutionTicks();
+                    renderBlock();
+                    const auto blockTicks = juce::Time::getHighResolutionTicks() - blockStartTicks;
+                    results.blockMicros.push_back (juce::Time::highResolutionTicksToSeconds (blockTicks) * 1.0e6);
+                }
+
+                results.wallSeconds =
+                    juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+
+                const auto allocationsAfter = AllocationCounter::getRealtime();
+                results.audioThreadAllocations = { allocationsAfter.numAllocations - allocationsBefore.numAllocations,
+                    allocationsAfter.numBytes - allocationsBefore.numBytes };
+            });
+
+            audioThread.join();
+            return results;
+        }
+
+        PluginHost& getHost() { return benchmarkHost.getHost(); }
+
+    private:
+        const Options options;
+        BenchmarkHost benchmarkHost;
+    };
+
+    static double getPercentile (std::vector<double> sortedValues, double percentile) {
+        if (sortedValues.empty()) return 0.0;
+        const auto index = (size_t) std::ceil (percentile * (double) sortedValues.size()) - 1;
+        return sortedValues[juce::jlimit ((size_t) 0, sortedValues.size() - 1, index)];
+    }
+
+    // Returns true if the audio thread stayed realtime-safe
+    static bool checkRealtimeSafety (const Options& options, const Results& results) {
+#if TIMEOFFAUDIO_REALTIME_SANITIZER
+        const auto violations = RealtimeSanitizer::getViolations();
+        for (const auto& violation : violations) {
+            std::cerr << "realtime safety violation: " << RealtimeSanitizer::getViolationTypeName (violation.type);
+            if (violation.size > 0) std::cerr << " of " << violation.size << " bytes";
+            std::cerr << "\n" << violation.stackTrace << "\n";
+        }
+
+        if (RealtimeSanitizer::getNumViolations() > 0) {
+            std::cerr << RealtimeSanitizer::getNumViolations() << " realtime safety violations\n";
+            return false;
+        }
+#endif
+
+        if (options.failOnAllocations && results.audioThreadAllocations.numAllocations > 0) {
+            std::cerr << results.audioThreadAllocations.numAllocations << " allocations on the audio thread\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    static void printResults (const Options& options, Results results) {
+        std::sort (results.blockMicros.begin(), results.blockMicros.end());
+
+        const auto audioSeconds = (double) options.numBlocks * options.blockSize / options.sampleRate;
+        const auto deadline     = 1.0e6 * options.blockSize / options.sampleRate;
+
+        std::cout << "graph:              " << options.graph.joinIntoString (" -> ") << "\n"
+                  << "blocks:             " << options.numBlocks << " x " << options.blockSize << " samples @ "
+                  << options.sampleRate << " Hz, " << options.numChannels << " channels\n"
+                  << "wall time:          " << results.wallSeconds * 1000.0 << " ms\n"
+                  << "throughput:         " << (double) options.numBlocks / results.wallSeconds << " blocks/s ("
+                  << audioSeconds / results.wallSeconds << "x realtime)\n"
+                  << "block deadline:     " << deadline << " us\n"
+                  << "block latency (us): p50 " << getPercentile (results.blockMicros, 0.5) << ", p90 "
+                  << getPercentile (results.blockMicros, 0.9) << ", p99 " << getPercentile (results.blockMicros, 0.99)
+                  << ", p99.9 " << getPercentile (results.blockMicros, 0.999) << ", max "
+                  << results.blockMicros.back() << "\n"
+                  << "audio thread allocations: " << results.audioThreadAllocations.numAllocations << " ("
+                  << results.audioThreadAllocations.numBytes << " bytes)\n";
+    }
+}
+
+int main (int argc, char* argv[]) {
+    using namespace timeoffaudio::benchmark;
+
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    const auto options = Options::fromArguments (juce::ArgumentList (argc, argv));
+
+    if (options.graph.isEmpty()) {
+        std::cerr << "The --graph option needs at least one processor\n";
+        return 1;
+    }
+
+    OfflineRenderHarness harness (options);
+    if (!harness.load()) {
+        std::cerr << "Failed to load the benchmark graph: " << options.graph.joinIntoString (",") << "\n";
+        return 1;
+    }
+
+    harness.getHost().setProcessingProfilerEnabled (options.profile);
+    const auto results = harness.run();
+    printResults (options, results);
+
+    if (options.profile)
+        std::cout << choc::json::toString (harness.getHost().getProcessingStats(), true) << "\n";
+
+    return checkRealtimeSafety (options, results) ? 0 : 1;
+}
@@ -0,0 +1,254 @@
+#pragma once
+#include "../PluginScanFilter.h"
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <juce_events/juce_events.h>
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace timeoffaudio::scanner {
+    /*
+        Headless batch mode, to prebuild the plugin index once instead of scanning on every machine:
+
+            PluginScanner --batch --output <file> [--blacklist <file>] [--jobs <n>] [--timeout <seconds>]
+                          [--formats <name,name>] [--effects-only [--host-name <name>]]
+
+        Walks the default search paths of every format and scans each plugin file in its own worker process
+        (this executable, run with --batch-scan-file), several at a time. Files whose worker crashes, fails or
+        times out get blacklisted. The output is a KnownPluginList XML, including the blacklist, i.e. the format
+        PluginHost loads its plugin list file in. --blacklist additionally writes the blacklisted files one per line.
+        --effects-only keeps the plugins PluginHost would (see isHostablePlugin), minus the host given by --host-name.
+    */
+    class BatchScanner {
+    public:
+        static constexpr const char* batchArgument    = "--batch";
+        static constexpr const char* scanFileArgument = "--batch-scan-file";
+        static constexpr const char* descriptionsTag  = "LIST";
+        static constexpr int defaultTimeoutSeconds    = 60;
+
+        static bool isBatchCommandLine (const juce::StringArray& arguments) {
+            return arguments.contains (batchArgument) || arguments.contains (scanFileArgument);
+        }
+
+        /*
+            Runs the batch mode once the message loop is up, rather than blocking JUCEApplication::initialise: the
+            batch scan on a thread of its own, and a worker's scan of its file on the message thread, where plugins
+            expect to be created. onFinished gets the process' exit code, on the message thread.
+        */
+        class Launcher final : private juce::Thread {
+        public:
+            Launcher (const juce::StringArray& argumentsToRun, std::function<void (int)> onFinishedFn)
+                : juce::Thread ("batchScan"), arguments (argumentsToRun), onFinished (std::move (onFinishedFn)) {
+                if (arguments.contains (scanFileArgument))
+                    juce::MessageManager::callAsync ([this] { onFinished (BatchScanner::run (arguments)); });
+                else
+                    startThread();
+            }
+
+            ~Launcher() override { stopThread (-1); }
+
+        private:
+            const juce::StringArray arguments;
+            const std::function<void (int)> onFinished;
+
+            void run() override {
+                const auto exitCode = BatchScanner::run (arguments);
+                juce::MessageManager::callAsync ([this, exitCode] { onFinished (exitCode); });
+            }
+
+            JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Launcher)
+        };
+
+        // Runs the batch mode the arguments ask for, and returns the process' exit code
+        static int run (const juce::StringArray& arguments) {
+            if (const auto index = arguments.indexOf (scanFileArgument); index >= 0) {
+                if (arguments.size() < index + 4) return printUsage();
+                return scanFile (arguments[index + 1], arguments[index + 2], juce::File (arguments[index + 3]));
+            }
+
+            const auto output = getOption (arguments, "--output");
+            if (output.isEmpty()) return printUsage();
+
+            BatchScanner scanner;
+            scanner.numJobs = juce::jmax (1,
+                getOption (arguments, "--jobs", juce::String (juce::SystemStats::getNumCpus())).getIntValue());
+            scanner.timeoutMs = 1000
+                                * juce::jmax (1,
+                                    getOption (arguments, "--timeout", juce::String (defaultTimeoutSeconds))
+                                        .getIntValue());
+            scanner.effectsOnly = arguments.contains ("--effects-only");
+            scanner.hostName    = getOption (arguments, "--host-name");
+
+            const auto formatNames = juce::StringArray::fromTokens (getOption (arguments, "--formats"), ",", "");
+            return scanner.scanAll (formatNames, juce::File::getCurrentWorkingDirectory().getChildFile (output),
+                getOption (arguments, "--blacklist"));
+        }
+
+    private:
+        struct Candidate {
+            juce::String formatName, fileOrIdentifier;
+        };
+
+        struct RunningScan {
+            Candidate candidate;
+            juce::ChildProcess process;
+            juce::File resultFile;
+            juce::uint32 startMs = 0;
+        };
+
+        juce::AudioPluginFormatManager formatManager;
+        juce::KnownPluginList list;
+        int numJobs = 1, timeoutMs = defaultTimeoutSeconds * 1000;
+        bool effectsOnly = false;
+        juce::String hostName;
+
+        BatchScanner() {
+            formatManager.addFormat (new juce::VST3PluginFormat());
+#if JUCE_MAC
+            formatManager.addFormat (new juce::AudioUnitPluginFormat());
+#endif
+        }
+
+        int scanAll (const juce::StringArray& formatNames,
+            const juce::File& outputFile,
+            const juce::String& blacklist) {
+            std::vector<Candidate> candidates;
+            for (auto* format : formatManager.getFormats()) {
+                if (!formatNames.isEmpty() && !formatNames.contains (format->getName(), true)) continue;
+                if (!format->canScanForPlugins()) continue;
+
+                for (const auto& fileOrIdentifier :
+                    format->searchPathsForPlugins (format->getDefaultLocationsToSearch(), true, true))
+                    candidates.push_back ({ format->getName(), fileOrIdentifier });
+            }
+
+            std::cout << "Scanning " << candidates.size() << " plugin files with " << numJobs << " workers"
+                      << std::endl;
+
+            const auto temporaryFolder =
+                juce::File::createTempFile ("pluginscan").getSiblingFile ("pluginscan-" + juce::Uuid().toString());
+            temporaryFolder.createDirectory();
+
+            std::vector<std::unique_ptr<RunningScan>> running;
+            size_t nextCandidate = 0, numFinished = 0;
+
+            while (nextCandidate < candidates.size() || !running.empty()) {
+                while ((int) running.size() < numJobs && nextCandidate < candidates.size()) {
+                    auto scan        = std::make_unique<RunningScan>();
+                    scan->candidate  = candidates[nextCandidate];
+                    scan->resultFile = temporaryFolder.getChildFile (juce::String ((int) nextCandidate) + ".xml");
+                    scan->startMs    = juce::Time::getMillisecondCounter();
+                    ++nextCandidate;
+
+                    const juce::StringArray command {
+                        juce::File::getSpecialLocation (juce::File::currentExecutableFile).getFullPathName(),
+                        scanFileArgument,
+                        scan->candidate.formatName,
+                        scan->candidate.fileOrIdentifier,
+                        scan->resultFile.getFullPathName(),
+                    };
+
+                    if (scan->process.start (command, 0))
+                        running.push_back (std::move (scan));
+                    else
+                        finishScan (*scan, false, ++numFinished, candidates.size());
+                }
+
+                for (auto it = running.begin(); it != running.end();) {
+                    auto& scan          = **it;
+                    const auto timedOut = juce::Time::getMillisecondCounter() - scan.startMs > (juce::uint32) timeoutMs;
+
+                    if (scan.process.isRunning() && !timedOut) {
+                        ++it;
+                        continue;
+                    }
+
+                    if (timedOut) scan.process.kill();
+                    finishScan (scan, !timedOut && scan.process.getExitCode() == 0, ++numFinished, candidates.size());
+                    it = running.erase (it);
+                }
+
+                juce::Thread::sleep (10);
+            }
+
+            temporaryFolder.deleteRecursively();
+
+            const auto xml = list.createXml();
+            if (!xml || !outputFile.getParentDirectory().createDirectory() || !xml->writeTo (outputFile)) {
+                std::cerr << "Could not write " << outputFile.getFullPathName() << std::endl;
+                return 1;
+            }
+
+            if (blacklist.isNotEmpty()) {
+                const auto blacklistFile = juce::File::getCurrentWorkingDirectory().getChildFile (blacklist);
+                blacklistFile.replaceWithText (list.getBlacklistedFiles().joinIntoString ("\n"));
+            }
+
+            std::cout << "Found " << list.getNumTypes() << " plugins, blacklisted "
+                      << list.getBlacklistedFiles().size() << " files" << std::endl;
+            return 0;
+        }
+
+        void finishScan (RunningScan& scan, const bool succeeded, const size_t numFinished, const size_t numTotal) {
+            const auto& [formatName, fileOrIdentifier] = scan.candidate;
+            const auto results                         = succeeded ? juce::parseXML (scan.resultFile) : nullptr;
+
+            int numFound = 0;
+            if (results && results->hasTagName (descriptionsTag)) {
+                for (const auto* item : results->getChildIterator()) {
+                    juce::PluginDescription description;
+                    if (!description.loadFromXml (*item)) continue;
+                    if (effectsOnly && !isHostablePlugin (description, hostName)) continue;
+
+                    list.addType (description);
+                    ++numFound;
+                }
+            } else {
+                list.addToBlacklist (fileOrIdentifier);
+            }
+
+            std::cout << "[" << numFinished << "/" << numTotal << "] " << formatName << " " << fileOrIdentifier
+                      << (results ? ": " + juce::String (numFound) + " plugins" : juce::String (": failed"))
+                      << std::endl;
+        }
+
+        // Worker side, scans a single file and writes its descriptions to resultFile
+        static int scanFile (const juce::String& formatName,
+            const juce::String& fileOrIdentifier,
+            const juce::File& resultFile) {
+            BatchScanner scanner;
+
+            for (auto* format : scanner.formatManager.getFormats()) {
+                if (format->getName() != formatName) continue;
+                if (!format->fileMightContainThisPluginType (fileOrIdentifier)) return 1;
+
+                juce::OwnedArray<juce::PluginDescription> results;
+                format->findAllTypesForFile (results, fileOrIdentifier);
+
+                juce::XmlElement xml (descriptionsTag);
+                for (const auto* description : results) xml.addChildElement (description->createXml().release());
+                return xml.writeTo (resultFile) ? 0 : 1;
+            }
+
+            return 1;
+        }
+
+        static juce::String getOption (const juce::StringArray& arguments,
+            const juce::String& name,
+            const juce::String& defaultValue = {}) {
+            const auto index = arguments.indexOf (name);
+            return index >= 0 && index + 1 < arguments.size() ? arguments[index + 1] : defaultValue;
+        }
+
+        static int printUsage() {
+            std::cerr << "Usage: PluginScanner --batch --output <file> [--blacklist <file>] [--jobs <n>] "
+                         "[--timeout <seconds>] [--formats <name,name>] [--effects-only [--host-name <name>]]"
+                      << std::endl;
+            return 2;
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BatchScanner)
+    };
+}
@@ -0,0 +1,221 @@
+#pragma once
+#include "../SandboxTransport.h"
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <juce_events/juce_events.h>
+
+#include <mutex>
+#include <vector>
+
+namespace timeoffaudio::scanner {
+    /*
+        The sandbox side of a SandboxedPluginInstance: hosts a single plugin, loaded and controlled over the
+        ChildProcessWorker connection (see SandboxCommand), and processed on a realtime thread that answers the
+        host's blocks over shared memory (see SandboxBlock).
+
+        Control messages are handled on the message thread, as plugins expect to be created and set up there.
+        Preparing the plugin waits for the block in progress, if any.
+    */
+    class SandboxWorker final : private juce::ChildProcessWorker, private juce::Thread {
+    public:
+        SandboxWorker() : juce::Thread ("sandboxAudio") {
+            formatManager.addFormat (new juce::VST3PluginFormat());
+#if JUCE_MAC
+            formatManager.addFormat (new juce::AudioUnitPluginFormat());
+#endif
+        }
+
+        ~SandboxWorker() override {
+            stopThread (1000);
+            instance.reset();
+        }
+
+        using juce::ChildProcessWorker::initialiseFromCommandLine;
+
+    private:
+        juce::AudioPluginFormatManager formatManager;
+        std::unique_ptr<juce::AudioPluginInstance> instance;
+        SandboxSharedMemory memory;
+
+        // Held while processing a block, and while the plugin is being prepared or its state changed
+        std::mutex processMutex;
+
+        // Preallocated, so that processing a block doesn't allocate
+        juce::MidiBuffer midiMessages;
+        std::vector<float> appliedParameterValues;
+        juce::Array<juce::AudioProcessorParameter*> parameters;
+
+        void handleMessageFromCoordinator (const juce::MemoryBlock& message) override {
+            juce::MessageManager::callAsync ([this, message] { handleCommand (message); });
+        }
+
+        void handleConnectionLost() override { juce::JUCEApplicationBase::quit(); }
+
+        void handleCommand (const juce::MemoryBlock& message) {
+            juce::MemoryInputStream stream (message, false);
+            const auto requestId = stream.readInt();
+            const auto command   = stream.readString();
+
+            // The coordinator matches replies to its requests by their id and command
+            juce::MemoryBlock reply;
+            {
+                juce::MemoryOutputStream replyStream (reply, false);
+                replyStream.writeInt (requestId);
+                replyStream.writeString (command);
+
+                if (command == SandboxCommand::load)
+                    load (stream, replyStream);
+                else if (command == SandboxCommand::prepare)
+                    prepare (stream, replyStream);
+                else if (command == SandboxCommand::getState && instance) {
+                    juce::MemoryBlock state;
+                    instance->getStateInformation (state);
+                    replyStream.write (state.getData(), state.getSize());
+                } else if (command == SandboxCommand::setState && instance) {
+                    juce::MemoryBlock state;
+                    stream.readIntoMemoryBlock (state);
+
+                    const std::lock_guard lock (processMutex);
+                    instance->setStateInformation (state.getData(), (int) state.getSize());
+
+                    // The host's parameter mirrors and the shared values follow the restored state
+                    auto* block = memory.get();
+                    replyStream.writeInt (parameters.size());
+                    for (int index = 0; index < parameters.size(); ++index) {
+                        const auto value                       = parameters[index]->getValue();
+                        appliedParameterValues[(size_t) index] = value;
+                        block->parameterValues[index].store (value);
+                        replyStream.writeFloat (value);
+                    }
+                }
+            }
+
+            sendMessageToCoordinator (reply);
+        }
+
+        void load (juce::MemoryInputStream& stream, juce::MemoryOutputStream& reply) {
+            juce::PluginDescription description;
+            if (const auto xml = juce::parseXML (stream.readString())) description.loadFromXml (*xml);
+            const auto sampleRate = stream.readDouble();
+            const auto blockSize  = stream.readInt();
+            const auto memoryName = stream.readString();
+
+            juce::String errorMessage;
+            if (!memory.open (memoryName))
+                errorMessage = "Could not open the shared memory";
+            else
+                instance = formatManager.createPluginInstance (description, sampleRate, blockSize, errorMessage);
+
+            reply.writeBool (instance != nullptr);
+            reply.writeString (errorMessage);
+            if (!instance) return;
+
+            instance->enableAllBuses();
+            instance->prepareToPlay (sampleRate, blockSize);
+            midiMessages.ensureSize (SandboxBlock::maxMidiBytes);
+
+            // Parameters are mirrored by the host, and their values shared from then on
+            auto* block = memory.get();
+            parameters  = instance->getParameters();
+            parameters.removeRange (SandboxBlock::maxParameters, parameters.size());
+            appliedParameterValues.assign ((size_t) parameters.size(), 0.f);
+
+            juce::XmlElement parametersXml ("PARAMETERS");
+            for (int index = 0; index < parameters.size(); ++index) {
+                auto* parameter = parameters[index];
+                auto* xml       = parametersXml.createNewChildElement ("PARAM");
+                xml->setAttribute ("id", juce::String (index));
+                if (const auto* hosted = dynamic_cast<juce::HostedAudioProcessorParameter*> (parameter))
+                    xml->setAttribute ("id", hosted->getParameterID());
+                xml->setAttribute ("name", parameter->getName (1024));
+                xml->setAttribute ("label", parameter->getLabel());
+                xml->setAttribute ("default", parameter->getDefaultValue());
+                xml->setAttribute ("value", parameter->getValue());
+                xml->setAttribute ("numSteps", parameter->getNumSteps());
+                xml->setAttribute ("discrete", parameter->isDiscrete());
+                xml->setAttribute ("boolean", parameter->isBoolean());
+
+                appliedParameterValues[(size_t) index] = parameter->getValue();
+                block->parameterValues[index].store (parameter->getValue());
+            }
+            block->numParameters = parameters.size();
+
+            reply.writeInt (instance->getLatencySamples());
+            reply.writeDouble (instance->getTailLengthSeconds());
+            reply.writeBool (instance->acceptsMidi());
+            reply.writeBool (instance->producesMidi());
+            reply.writeString (parametersXml.toString());
+
+            startRealtimeThread (juce::Thread::RealtimeOptions().withMaximumProcessingTimeMs (
+                1000.0 * blockSize / juce::jmax (1.0, sampleRate)));
+        }
+
+        void prepare (juce::MemoryInputStream& stream, juce::MemoryOutputStream& reply) {
+            const auto sampleRate = stream.readDouble();
+            const auto blockSize  = stream.readInt();
+
+            if (instance) {
+                const std::lock_guard lock (processMutex);
+                instance->prepareToPlay (sampleRate, blockSize);
+            }
+
+            reply.writeInt (instance ? instance->getLatencySamples() : 0);
+        }
+
+        // Answers the host's blocks, see SandboxBlock
+        void run() override {
+            auto* block       = memory.get();
+            auto lastSequence = block->requestSequence.load (std::memory_order_acquire);
+
+            while (!threadShouldExit()) {
+                // Wakes up now and then to check whether it should exit
+                if (!SandboxSharedMemory::wait (block->requestSequence, lastSequence, 100.0)) continue;
+
+                lastSequence = block->requestSequence.load (std::memory_order_acquire);
+                processBlock (*block);
+                block->responseSequence.store (lastSequence, std::memory_order_release);
+                SandboxSharedMemory::wake (block->responseSequence);
+            }
+        }
+
+        void processBlock (SandboxBlock& block) /* context: realtime */ {
+            const std::lock_guard lock (processMutex);
+
+            const auto numSamples      = juce::jlimit (0, SandboxBlock::maxBlockSize, block.numSamples);
+            const auto numHostChannels = juce::jlimit (0, SandboxBlock::maxChannels, block.numChannels);
+            const auto numChannels     = juce::jmin (SandboxBlock::maxChannels,
+                juce::jmax (instance->getTotalNumInputChannels(), instance->getTotalNumOutputChannels()));
+
+            // The plugin processes the shared memory in place
+            float* channels[SandboxBlock::maxChannels];
+            for (int channel = 0; channel < numChannels; ++channel) {
+                channels[channel] = block.audio[channel];
+                if (channel >= numHostChannels) juce::FloatVectorOperations::clear (channels[channel], numSamples);
+            }
+            juce::AudioBuffer<float> buffer (channels, numChannels, numSamples);
+
+            for (size_t index = 0; index < appliedParameterValues.size(); ++index) {
+                const auto value = block.parameterValues[index].load (std::memory_order_relaxed);
+                if (value == appliedParameterValues[index]) continue;
+
+                parameters[(int) index]->setValue (value);
+                appliedParameterValues[index] = value;
+            }
+
+            SandboxSharedMemory::readMidi (block.midi, block.numMidiBytes, midiMessages);
+
+            const auto isBypassed = block.bypassValue.load (std::memory_order_relaxed) >= 0.5f;
+            if (auto* bypassParameter = instance->getBypassParameter()) {
+                if ((bypassParameter->getValue() >= 0.5f) != isBypassed) bypassParameter->setValue (isBypassed);
+                instance->processBlock (buffer, midiMessages);
+            } else if (isBypassed) {
+                instance->processBlockBypassed (buffer, midiMessages);
+            } else {
+                instance->processBlock (buffer, midiMessages);
+            }
+
+            block.numMidiBytes = SandboxSharedMemory::writeMidi (midiMessages, block.midi, block.midiOverflowed);
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SandboxWorker)
+    };
+}
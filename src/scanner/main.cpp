@@ -1,3 +1,5 @@
+#include "BatchScanner.h"
+#include "SandboxWorker.h"
 #include "Worker.h"
 #include <juce_events/juce_events.h>
 
@@ -14,7 +16,7 @@ namespace timeoffaudio {
             void anotherInstanceStarted (const juce::String& commandLine) override {}
             void suspended() override {}
             void resumed() override {}
-            void shutdown() override {}
+            void shutdown() override { batchScan.reset(); }
 
             void systemRequestedQuit() override { quit(); }
 
@@ -25,6 +27,24 @@ namespace timeoffaudio {
             }
 
             void initialise (const juce::String& commandLineParameters) override {
+                // Batch mode runs to completion without a coordinator, see BatchScanner
+                if (const auto arguments = getCommandLineParameterArray();
+                    BatchScanner::isBatchCommandLine (arguments)) {
+                    batchScan = std::make_unique<BatchScanner::Launcher> (arguments, [this] (const int exitCode) {
+                        setApplicationReturnValue (exitCode);
+                        quit();
+                    });
+                    return;
+                }
+
+                // Launched by a SandboxedPluginInstance, to host a plugin rather than scan
+                if (auto sandbox = std::make_unique<SandboxWorker>();
+                    sandbox->initialiseFromCommandLine (commandLineParameters, SANDBOX_PROCESS_UID)) {
+                    juce::SystemStats::setApplicationCrashHandler (crashHandler);
+                    sandboxWorker = std::move (sandbox);
+                    return;
+                }
+
                 auto scannerWorker = std::make_unique<timeoffaudio::scanner::Worker> ();
                 if (!scannerWorker->initialiseFromCommandLine (commandLineParameters, PROCESS_UID)) {
                     return;
@@ -44,6 +64,8 @@ namespace timeoffaudio {
 
         private:
             std::unique_ptr<timeoffaudio::scanner::Worker> worker;
+            std::unique_ptr<SandboxWorker> sandboxWorker;
+            std::unique_ptr<BatchScanner::Launcher> batchScan;
         };
     }
 }